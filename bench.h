@@ -0,0 +1,522 @@
+#pragma once
+
+// Micro benchmarks, run with `sokoban --bench <name>`. Results go to stdout.
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "level.h"
+#include "observe.h"
+#include "search.h"
+#include "visited.h"
+#include "zobrist.h"
+
+#define BENCH_VISITED_BYTES ((size_t)64 << 20)
+// Fill the table up to this load factor.
+#define BENCH_VISITED_LOAD 0.7
+// Flood fills from every free cell of the level, this many times over.
+#define BENCH_FLOOD_ROUNDS 20000
+// Moves replayed by each kernel.
+#define BENCH_MOVES 50000000
+// Games stepped together, each this many times.
+#define BENCH_BATCH_GAMES 4096
+#define BENCH_BATCH_STEPS 20000
+// Observations of every game of the batch, this many times over.
+#define BENCH_BATCH_OBSERVE_ROUNDS 500
+// Random actions drawn up front, replayed in a loop.
+#define BENCH_BATCH_ACTIONS_LEN (BENCH_BATCH_GAMES * 64)
+
+typedef struct {
+  VisitedSet *set;
+  pthread_t thread;
+  uint32_t index, threads;
+  uint64_t keys_len; // Distinct keys over all threads.
+  uint64_t inserted;
+  bool full;
+} BenchVisitedWorker;
+
+// Sequential, like the crate bits of nearby states.
+static VisitedKey bench_visited_key(uint64_t i) {
+  return visited_key(i, i >> 16);
+}
+
+// Key `i` belongs to thread `i % threads`. Every thread inserts its own keys
+// and, at the same time, those of the next thread, so that each key is raced
+// for by two threads.
+static void *bench_visited_run(void *arg) {
+  BenchVisitedWorker *const worker = arg;
+  const uint32_t next = (worker->index + 1) % worker->threads;
+  for (uint64_t i = worker->index, j = next; i < worker->keys_len;
+       i += worker->threads, j += worker->threads) {
+    const VisitedResult mine =
+        visited_insert(worker->set, bench_visited_key(i));
+    const VisitedResult theirs =
+        j < worker->keys_len ? visited_insert(worker->set, bench_visited_key(j))
+                             : VISITED_PRESENT;
+    worker->inserted +=
+        (mine == VISITED_INSERTED) + (theirs == VISITED_INSERTED);
+    worker->full |= mine == VISITED_FULL || theirs == VISITED_FULL;
+  }
+  return 0;
+}
+
+// Returns false if the set lost or duplicated a key.
+static bool bench_visited_once(uint32_t threads, double *elapsed_s,
+                               VisitedStats *stats) {
+  VisitedSet set;
+  if (!visited_init(&set, BENCH_VISITED_BYTES)) {
+    fprintf(stderr, "Failed to allocate the visited set\n");
+    return false;
+  }
+  const uint64_t keys_len = (uint64_t)((set.mask + 1) * BENCH_VISITED_LOAD);
+
+  BenchVisitedWorker *workers = calloc(threads, sizeof(BenchVisitedWorker));
+  SDL_assert(workers != 0);
+  const double start = now_s();
+  for (uint32_t t = 0; t < threads; t++) {
+    workers[t] = (BenchVisitedWorker){
+        .set = &set, .index = t, .threads = threads, .keys_len = keys_len};
+    pthread_create(&workers[t].thread, 0, bench_visited_run, &workers[t]);
+  }
+
+  uint64_t inserted = 0;
+  bool full = false;
+  for (uint32_t t = 0; t < threads; t++) {
+    pthread_join(workers[t].thread, 0);
+    inserted += workers[t].inserted;
+    full |= workers[t].full;
+  }
+  *elapsed_s = now_s() - start;
+  *stats = visited_stats(&set);
+  free(workers);
+  visited_destroy(&set);
+
+  if (full || inserted != keys_len || stats->len != keys_len) {
+    fprintf(stderr, "Visited set: %llu keys, inserted %llu, stored %llu%s\n",
+            (unsigned long long)keys_len, (unsigned long long)inserted,
+            (unsigned long long)stats->len, full ? ", full" : "");
+    return false;
+  }
+  return true;
+}
+
+// Concurrent inserts into `VisitedSet`, from 1 thread up to every core.
+static bool bench_visited(void) {
+  const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  const uint32_t max_threads = cores > 0 ? (uint32_t)cores : 1;
+
+  printf("threads  time (s)  Minserts/s  speedup  load  mean probes  "
+         "max probes\n");
+  double base_rate = 0;
+  for (uint32_t threads = 1;; threads *= 2) {
+    if (threads > max_threads)
+      threads = max_threads;
+
+    double elapsed_s;
+    VisitedStats stats;
+    if (!bench_visited_once(threads, &elapsed_s, &stats))
+      return false;
+
+    // Every key is inserted twice.
+    const double rate = 2 * stats.len / elapsed_s / 1e6;
+    if (threads == 1)
+      base_rate = rate;
+    printf("%7u  %8.3f  %10.1f  %7.2f  %.2f  %11.2f  %10u\n", threads,
+           elapsed_s, rate, rate / base_rate, stats.load_factor,
+           stats.mean_probes, stats.max_probes);
+    if (threads == max_threads)
+      break;
+  }
+  return true;
+}
+
+// Where the flood fill results go, so that none is optimized away.
+static volatile uint64_t bench_flood_sink;
+
+typedef enum {
+  BENCH_FLOOD_BFS,
+  BENCH_FLOOD_SCALAR,
+  BENCH_FLOOD_SIMD,
+} BenchFlood;
+
+// Flood fills from each of the `starts_len` cells of `starts`, `rounds` times
+// over, on `map`, `width` by `height` cells.
+static void bench_flood_once(BenchFlood kind, const Entity *map,
+                             uint32_t width, uint32_t height,
+                             const CellSet *free, const uint16_t *starts,
+                             uint32_t starts_len, uint32_t rounds) {
+  const uint32_t size = width * height;
+  const uint8_t words = BITMAP_WORDS(size);
+  int32_t neighbours[4];
+  map_neighbours(width, neighbours);
+  uint64_t sum = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    for (uint32_t s = 0; s < starts_len; s++) {
+      bool reachable[MAP_MAX_SIZE];
+      CellSet reachable_set;
+      switch (kind) {
+      case BENCH_FLOOD_BFS:
+        sum += flood_fill(map, size, neighbours, starts[s], reachable);
+        break;
+      case BENCH_FLOOD_SCALAR:
+        sum += cellset_flood_fill_scalar(free, words, width, starts[s],
+                                         &reachable_set);
+        break;
+      case BENCH_FLOOD_SIMD:
+        sum += cellset_flood_fill(free, words, width, starts[s],
+                                  &reachable_set);
+        break;
+      }
+    }
+  }
+  bench_flood_sink += sum;
+}
+
+// The character reachability of the push-level searches: `flood_fill()`
+// over the `Entity` cells against the bitboard flood fills, from every free
+// cell of `map`, `width` by `height` cells. Returns false if they disagree.
+static bool bench_flood(const Entity *map, uint32_t width, uint32_t height) {
+  if (width > MAP_MAX_WIDTH || height > MAP_MAX_HEIGHT) {
+    fprintf(stderr, "Level of %ux%u, larger than the %dx%d of the solver\n",
+            width, height, MAP_MAX_WIDTH, MAP_MAX_HEIGHT);
+    return false;
+  }
+
+  const uint32_t size = width * height;
+  const uint8_t words = BITMAP_WORDS(size);
+  int32_t neighbours[4];
+  map_neighbours(width, neighbours);
+  // The floor inside the walls, without the crates.
+  CellSet free;
+  uint32_t open_i = 0;
+  if (!map_is_enclosed(map, width, height, &open_i, free.words)) {
+    fprintf(stderr, "Level not walled in\n");
+    return false;
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    if (bitset_contains(map[i], ENTITY_CRATE))
+      cellset_remove(&free, i);
+  }
+
+  uint16_t starts[MAP_MAX_SIZE];
+  uint32_t starts_len = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (!cellset_contains(&free, i))
+      continue;
+    starts[starts_len++] = i;
+
+    bool reachable[MAP_MAX_SIZE];
+    CellSet scalar, simd;
+    const uint32_t region_i = flood_fill(map, size, neighbours, i, reachable);
+    if (cellset_flood_fill_scalar(&free, words, width, i, &scalar) !=
+            region_i ||
+        cellset_flood_fill(&free, words, width, i, &simd) != region_i) {
+      fprintf(stderr, "Flood fill from %u: regions differ\n", i);
+      return false;
+    }
+    for (uint32_t j = 0; j < size; j++) {
+      if (cellset_contains(&scalar, j) != reachable[j] ||
+          cellset_contains(&simd, j) != reachable[j]) {
+        fprintf(stderr, "Flood fill from %u: cell %u differs\n", i, j);
+        return false;
+      }
+    }
+  }
+
+  static const char *const NAMES[] = {
+      [BENCH_FLOOD_BFS] = "bfs",
+      [BENCH_FLOOD_SCALAR] = "bitboard",
+#ifdef __AVX2__
+      [BENCH_FLOOD_SIMD] = "avx2",
+#else
+      [BENCH_FLOOD_SIMD] = "bitboard", // No SIMD for this machine.
+#endif
+  };
+  const uint64_t fills = (uint64_t)starts_len * BENCH_FLOOD_ROUNDS;
+  printf("fill      time (s)  ns/fill  speedup\n");
+  double base_s = 0;
+  for (BenchFlood kind = BENCH_FLOOD_BFS; kind <= BENCH_FLOOD_SIMD; kind++) {
+    const double start = now_s();
+    bench_flood_once(kind, map, width, height, &free, starts, starts_len,
+                     BENCH_FLOOD_ROUNDS);
+    const double elapsed_s = now_s() - start;
+    if (kind == BENCH_FLOOD_BFS)
+      base_s = elapsed_s;
+    printf("%-8s  %8.3f  %7.1f  %7.2f\n", NAMES[kind], elapsed_s,
+           elapsed_s / fills * 1e9, base_s / elapsed_s);
+  }
+  return true;
+}
+
+// `go_by()` as it was before `GO_TABLE`, a chain of tests on the cells.
+static GoResult bench_go_branches(int32_t offset, uint32_t *character_cell_i,
+                                  Entity *map) {
+  const uint32_t next_cell_i = *character_cell_i + offset;
+  Entity *const next_cell = &map[next_cell_i];
+  if (bitset_is_exactly(*next_cell, ENTITY_WALL))
+    return GO_BLOCKED;
+
+  if (bitset_is_exactly(*next_cell, ENTITY_NONE) ||
+      bitset_is_exactly(*next_cell, ENTITY_OBJECTIVE)) {
+    bitset_remove(&map[*character_cell_i], ENTITY_CHARACTER);
+    bitset_add(next_cell, ENTITY_CHARACTER);
+    *character_cell_i = next_cell_i;
+    return GO_WALKED;
+  }
+
+  Entity *const next_next_cell = &map[next_cell_i + offset];
+  if (bitset_is_exactly(*next_next_cell, ENTITY_WALL) ||
+      bitset_contains(*next_next_cell, ENTITY_CRATE))
+    return GO_BLOCKED;
+
+  if (bitset_is_exactly(*next_next_cell, ENTITY_NONE) ||
+      bitset_contains(*next_next_cell, ENTITY_OBJECTIVE)) {
+    bitset_remove(&map[*character_cell_i], ENTITY_CHARACTER);
+    bitset_remove(next_cell, ENTITY_CRATE);
+    bitset_add(next_cell, ENTITY_CHARACTER);
+    bitset_add(next_next_cell, ENTITY_CRATE);
+    *character_cell_i = next_cell_i;
+    return GO_PUSHED;
+  }
+  return GO_BLOCKED;
+}
+
+typedef enum {
+  BENCH_MOVES_BRANCHES,
+  BENCH_MOVES_TABLE,
+  BENCH_MOVES_BITBOARDS,
+} BenchMoves;
+
+// Replay `solution` from the start of `level`, `rounds` times over. Returns
+// false if a move did not do what it says, or the level is not solved.
+static bool bench_moves_once(BenchMoves kind, const Level *level,
+                             const char *solution, size_t solution_len,
+                             uint32_t rounds) {
+  Entity *const start = malloc(level->size);
+  Entity *const map = malloc(level->size);
+  SDL_assert(start != 0);
+  SDL_assert(map != 0);
+  level_compose(level, &level->start, start);
+  GameState state;
+  game_state_init(level, &state);
+
+  bool ok = true;
+  for (uint32_t r = 0; r < rounds && ok; r++) {
+    __builtin_memcpy(map, start, level->size);
+    uint32_t character_cell_i = level->start.character_cell_i;
+    switch (kind) {
+    case BENCH_MOVES_BRANCHES:
+      for (size_t i = 0; i < solution_len; i++) {
+        const uint8_t step = LURD_STEPS[(uint8_t)solution[i]];
+        const GoResult expected = step > 4 ? GO_PUSHED : GO_WALKED;
+        ok &= bench_go_branches(level->neighbours[(step - 1) % 4],
+                                &character_cell_i, map) == expected;
+      }
+      break;
+    case BENCH_MOVES_TABLE:
+      ok = apply_moves(map, level->neighbours, &character_cell_i, solution,
+                       solution_len) == solution_len;
+      break;
+    case BENCH_MOVES_BITBOARDS:
+      game_state_copy(level, &state, &level->start);
+      for (size_t i = 0; i < solution_len; i++) {
+        const uint8_t step = LURD_STEPS[(uint8_t)solution[i]];
+        const GoResult expected = step > 4 ? GO_PUSHED : GO_WALKED;
+        ok &= game_go(level, &state, (step - 1) % 4) == expected;
+      }
+      level_compose(level, &state, map);
+      break;
+    }
+  }
+  for (uint32_t i = 0; i < level->size; i++)
+    ok &= !bitset_is_exactly(map[i], ENTITY_OBJECTIVE) &&
+          !bitset_is_exactly(map[i], ENTITY_CHARACTER | ENTITY_OBJECTIVE);
+
+  game_state_destroy(&state);
+  free(start);
+  free(map);
+  return ok;
+}
+
+// Replays of a solution of `map` (`width` by `height` cells): `go_by()` as a
+// chain of branches against `apply_moves()` and `game_go()`. Returns false if
+// the solution is not one.
+static bool bench_moves(const Entity *map, uint32_t width, uint32_t height,
+                        const char *solution) {
+  const size_t solution_len = strlen(solution);
+  for (size_t i = 0; i < solution_len; i++) {
+    if (LURD_STEPS[(uint8_t)solution[i]] == 0) {
+      fprintf(stderr, "Not a LURD move: `%c`\n", solution[i]);
+      return false;
+    }
+  }
+  Level level;
+  level_init(map, width, height, &level);
+  const uint32_t rounds =
+      solution_len ? BENCH_MOVES / solution_len + 1 : 1;
+
+  static const char *const NAMES[] = {
+      [BENCH_MOVES_BRANCHES] = "branches",
+      [BENCH_MOVES_TABLE] = "table",
+      [BENCH_MOVES_BITBOARDS] = "bitboards",
+  };
+  printf("kernel     time (s)  Mmoves/s  speedup\n");
+  double base_s = 0;
+  bool ok = true;
+  for (BenchMoves kind = BENCH_MOVES_BRANCHES;
+       kind <= BENCH_MOVES_BITBOARDS && ok; kind++) {
+    const double start = now_s();
+    ok = bench_moves_once(kind, &level, solution, solution_len, rounds);
+    const double elapsed_s = now_s() - start;
+    if (!ok)
+      break;
+    if (kind == BENCH_MOVES_BRANCHES)
+      base_s = elapsed_s;
+    printf("%-9s  %8.3f  %8.1f  %7.2f\n", NAMES[kind], elapsed_s,
+           (double)rounds * solution_len / elapsed_s / 1e6,
+           base_s / elapsed_s);
+  }
+  if (!ok)
+    fprintf(stderr, "Not a solution of the level\n");
+  level_destroy(&level);
+  return ok;
+}
+
+// Where the batch rewards go, so that none is optimized away.
+static volatile float bench_batch_sink;
+
+// `batch_step()` one game at a time with `game_go()`, `states` the games.
+static void bench_batch_games(const Level *level, GameState *states,
+                              const uint8_t *actions, float *rewards,
+                              uint8_t *dones) {
+  for (uint32_t g = 0; g < BENCH_BATCH_GAMES; g++) {
+    GameState *const state = &states[g];
+    const uint32_t next_next_cell_i =
+        state->character_cell_i + 2 * level->neighbours[actions[g]];
+    const GoResult result = game_go(level, state, actions[g]);
+    rewards[g] = BATCH_REWARD_STEP;
+    dones[g] = false;
+    if (result == GO_PUSHED) {
+      rewards[g] += BATCH_REWARD_OBJECTIVE *
+                    ((float)bitmap_contains(level->objectives,
+                                            next_next_cell_i) -
+                     (float)bitmap_contains(level->objectives,
+                                            state->character_cell_i));
+      dones[g] = bitmap_contains(level->dead_squares, next_next_cell_i);
+    }
+    if (game_is_won(level, state)) {
+      rewards[g] += BATCH_REWARD_WON;
+      dones[g] = true;
+    }
+    if (dones[g])
+      game_state_copy(level, state, &level->start);
+  }
+}
+
+// Games of `map` (`width` by `height` cells) stepped with random actions:
+// `game_go()` on each game against `batch_step()`. Returns false if they do
+// not play the same.
+static bool bench_batch(const Entity *map, uint32_t width, uint32_t height) {
+  Level level;
+  level_init(map, width, height, &level);
+  Batch batch;
+  batch_init(&level, BENCH_BATCH_GAMES, &batch);
+  GameState *states = malloc(BENCH_BATCH_GAMES * sizeof(GameState));
+  uint8_t *actions = malloc(BENCH_BATCH_ACTIONS_LEN);
+  float *rewards = malloc(BENCH_BATCH_GAMES * sizeof(float));
+  float *batch_rewards = malloc(BENCH_BATCH_GAMES * sizeof(float));
+  uint8_t *dones = malloc(BENCH_BATCH_GAMES);
+  uint8_t *batch_dones = malloc(BENCH_BATCH_GAMES);
+  SDL_assert(states != 0);
+  SDL_assert(actions != 0);
+  SDL_assert(rewards != 0);
+  SDL_assert(batch_rewards != 0);
+  SDL_assert(dones != 0);
+  SDL_assert(batch_dones != 0);
+  for (uint32_t g = 0; g < BENCH_BATCH_GAMES; g++) {
+    game_state_init(&level, &states[g]);
+    game_state_copy(&level, &states[g], &level.start);
+  }
+  uint64_t random = 0x9e3779b97f4a7c15;
+  for (uint32_t i = 0; i < BENCH_BATCH_ACTIONS_LEN; i++) {
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    actions[i] = random % 4;
+  }
+
+  // Both play the same, step by step.
+  bool ok = true;
+  for (uint32_t a = 0; a < BENCH_BATCH_ACTIONS_LEN && ok;
+       a += BENCH_BATCH_GAMES) {
+    bench_batch_games(&level, states, &actions[a], rewards, dones);
+    batch_step(&batch, &actions[a], batch_rewards, batch_dones);
+    for (uint32_t g = 0; g < BENCH_BATCH_GAMES && ok; g++) {
+      ok = rewards[g] == batch_rewards[g] && dones[g] == batch_dones[g] &&
+           states[g].character_cell_i == batch.characters[g];
+      for (uint32_t w = 0; w < batch.words; w++)
+        ok &= (uint32_t)(states[g].crates[w / 2] >> (w % 2 * 32)) ==
+              batch.crates[w * BENCH_BATCH_GAMES + g];
+    }
+  }
+  if (!ok)
+    fprintf(stderr, "The batch does not play like the games\n");
+
+  printf("kernel  time (s)  Msteps/s  speedup\n");
+  double base_s = 0;
+  for (uint32_t kernel = 0; kernel < 2 && ok; kernel++) {
+    float sum = 0;
+    const double start = now_s();
+    for (uint32_t s = 0; s < BENCH_BATCH_STEPS; s++) {
+      const uint8_t *const step_actions =
+          &actions[s * BENCH_BATCH_GAMES % BENCH_BATCH_ACTIONS_LEN];
+      if (kernel == 0)
+        bench_batch_games(&level, states, step_actions, rewards, dones);
+      else
+        batch_step(&batch, step_actions, rewards, dones);
+      sum += rewards[s % BENCH_BATCH_GAMES];
+    }
+    const double elapsed_s = now_s() - start;
+    bench_batch_sink += sum;
+    if (kernel == 0)
+      base_s = elapsed_s;
+    printf("%-6s  %8.3f  %8.1f  %7.2f\n", kernel == 0 ? "games" : "batch",
+           elapsed_s,
+           (double)BENCH_BATCH_GAMES * BENCH_BATCH_STEPS / elapsed_s / 1e6,
+           base_s / elapsed_s);
+  }
+
+  // Observations of the batch into one buffer, planes after planes.
+  const ObserveStrides strides = {.game = OBSERVE_PLANES_LEN * level.size,
+                                  .plane = level.size,
+                                  .row = level.width,
+                                  .cell = 1};
+  uint8_t *observations = malloc(BENCH_BATCH_GAMES * strides.game);
+  SDL_assert(observations != 0);
+  printf("observe  time (s)  Mobs/s\n");
+  for (ObserveFormat format = OBSERVE_GRID; format <= OBSERVE_PLANES && ok;
+       format++) {
+    const double start = now_s();
+    for (uint32_t r = 0; r < BENCH_BATCH_OBSERVE_ROUNDS; r++)
+      observe_batch(&batch, format, observations, &strides);
+    const double elapsed_s = now_s() - start;
+    printf("%-7s  %8.3f  %6.1f\n", format == OBSERVE_GRID ? "grid" : "planes",
+           elapsed_s,
+           (double)BENCH_BATCH_GAMES * BENCH_BATCH_OBSERVE_ROUNDS / elapsed_s /
+               1e6);
+  }
+
+  free(observations);
+  for (uint32_t g = 0; g < BENCH_BATCH_GAMES; g++)
+    game_state_destroy(&states[g]);
+  free(states);
+  free(actions);
+  free(rewards);
+  free(batch_rewards);
+  free(dones);
+  free(batch_dones);
+  batch_destroy(&batch);
+  level_destroy(&level);
+  return ok;
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+// Bidirectional push-level search.
+//
+// The forward side pushes crates from the initial position, the backward side
+// pulls them (see `pull_by()`) from every solved position: crates on all
+// objectives, with the character in any of the regions left free. Both sides
+// use the same push-level nodes and hashes, and share one transposition
+// table whose values are tagged with the side. The side with the smaller
+// frontier expands a whole layer at a time, until a node of one side is
+// found in the table with the other tag.
+//
+// Solutions are close to push-optimal, not guaranteed optimal.
+
+#include "search.h"
+
+#define BIDIRECTIONAL_BACKWARD (1U << 31)
+
+// Like `push_successors()`, backwards. No deadlock pruning: every pulled
+// position can reach a solved one by construction.
+static uint16_t pull_successors(const PackedLayout *layout,
+                                const SolverNode *node, SolverNode *children) {
+  const uint32_t size = layout->size;
+  uint16_t children_len = 0;
+  Entity map[MAP_MAX_SIZE];
+  unpack_state(layout, &node->state, map);
+  bool reachable[MAP_MAX_SIZE];
+  const uint32_t region_i = flood_fill(map, size, layout->neighbours,
+                                       node->state.character_cell_i, reachable);
+  const uint64_t crates_hash = node->hash ^ zobrist_keys.character[region_i];
+
+  for (uint32_t crate_i = 0; crate_i < size; crate_i++) {
+    if (!bitset_contains(map[crate_i], ENTITY_CRATE))
+      continue;
+
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const int32_t offset = layout->neighbours[dir];
+      const uint32_t new_crate_i = crate_i + offset;
+      if (!reachable[new_crate_i])
+        continue;
+
+      // Teleport the character next to the crate, then let `pull_by()`
+      // decide.
+      Entity child_map[MAP_MAX_SIZE];
+      __builtin_memcpy(child_map, map, size);
+      uint32_t character_cell_i = new_crate_i;
+      bitset_remove(&child_map[node->state.character_cell_i],
+                    ENTITY_CHARACTER);
+      bitset_add(&child_map[character_cell_i], ENTITY_CHARACTER);
+      if (pull_by(offset, &character_cell_i, child_map) != GO_PULLED)
+        continue;
+
+      bool child_reachable[MAP_MAX_SIZE];
+      const uint32_t child_region_i =
+          flood_fill(child_map, size, layout->neighbours, character_cell_i,
+                     child_reachable);
+      SolverNode *const child = &children[children_len++];
+      *child = *node;
+      packed_move_crate(layout, &child->state, crate_i, new_crate_i);
+      child->state.character_cell_i = character_cell_i;
+      child->hash = zobrist_move_crate(crates_hash, crate_i, new_crate_i) ^
+                    zobrist_keys.character[child_region_i];
+      child->move = LURD_PUSH[dir];
+      child->pushes = node->pushes + 1;
+      child->state.region_i = child_region_i;
+    }
+  }
+  return children_len;
+}
+
+// Forward path up to `forward_i`, then the pulls from `backward_i` up to its
+// root replayed as pushes.
+static char *bidirectional_backtrack(const Solver *forward,
+                                     const Solver *backward,
+                                     uint32_t forward_i, uint32_t backward_i) {
+  char *const forward_solution = solver_backtrack_pushes(forward, forward_i);
+  const size_t forward_len = strlen(forward_solution);
+
+  uint32_t pulls = 0;
+  for (uint32_t i = backward_i; backward->nodes[i].parent != SOLVER_NO_PARENT;
+       i = backward->nodes[i].parent)
+    pulls++;
+
+  const PackedLayout *const layout = &forward->layout;
+  const size_t per_pull = (size_t)layout->size + 1;
+  char *solution =
+      realloc(forward_solution, forward_len + pulls * per_pull + 1);
+  SDL_assert(solution != 0);
+
+  // Replay the forward half to know where the character stands.
+  Entity map[MAP_MAX_SIZE];
+  unpack_state(layout, &forward->nodes[0].state, map);
+  uint32_t character_cell_i = forward->nodes[0].state.character_cell_i;
+  for (size_t i = 0; i < forward_len; i++)
+    go_by(layout->neighbours[direction_from_lurd(solution[i])],
+          &character_cell_i, map);
+
+  size_t len = forward_len;
+  for (uint32_t i = backward_i; backward->nodes[i].parent != SOLVER_NO_PARENT;
+       i = backward->nodes[i].parent) {
+    const SolverNode *const node = &backward->nodes[i];
+    const int32_t walk_len =
+        walk_path(layout, map, character_cell_i, node->state.character_cell_i,
+                  &solution[len]);
+    SDL_assert(walk_len >= 0);
+    len += walk_len;
+    bitset_remove(&map[character_cell_i], ENTITY_CHARACTER);
+    character_cell_i = node->state.character_cell_i;
+    bitset_add(&map[character_cell_i], ENTITY_CHARACTER);
+
+    const Direction dir = direction_opposite(direction_from_lurd(node->move));
+    const GoResult res =
+        go_by(layout->neighbours[dir], &character_cell_i, map);
+    SDL_assert(res == GO_PUSHED);
+    (void)res;
+    solution[len++] = LURD_PUSH[dir];
+  }
+  solution[len] = 0;
+  return solution;
+}
+
+static void bidirectional_add_goals(Solver *forward, Solver *backward) {
+  const PackedLayout *const layout = &forward->layout;
+  const uint32_t size = layout->size;
+  Entity goal[MAP_MAX_SIZE];
+  for (uint32_t i = 0; i < size; i++) {
+    goal[i] = layout->statics[i];
+    if (bitset_contains(goal[i], ENTITY_OBJECTIVE))
+      bitset_add(&goal[i], ENTITY_CRATE);
+  }
+
+  // One root per region left free by the crates.
+  bool seen[MAP_MAX_SIZE] = {0};
+  for (uint32_t i = 0; i < size; i++) {
+    if (seen[i] || bitset_contains(goal[i], ENTITY_WALL) ||
+        bitset_contains(goal[i], ENTITY_CRATE))
+      continue;
+
+    bool reachable[MAP_MAX_SIZE];
+    SolverNode node = {.parent = SOLVER_NO_PARENT};
+    const uint32_t character_cell_i =
+        flood_fill(goal, size, layout->neighbours, i, reachable);
+    pack_state(layout, goal, character_cell_i, &node.state);
+    node.state.region_i = character_cell_i;
+    node.hash = zobrist_hash(goal, size, character_cell_i);
+    for (uint32_t j = 0; j < size; j++)
+      seen[j] |= reachable[j];
+
+    if (tt_insert(&forward->visited, node.hash,
+                  BIDIRECTIONAL_BACKWARD | backward->nodes_len))
+      solver_append(backward, &node);
+  }
+}
+
+static void solve_bidirectional(Solver *solver, SolverNode *root,
+                                SolverStats *stats) {
+  if (packed_is_won(&solver->layout, &root->state)) {
+    stats->solution = calloc(1, 1);
+    return;
+  }
+  if (!solver->use_matching) {
+    // The solved position is not unique: search forward only.
+    solve_pushes(solver, root, stats);
+    return;
+  }
+
+  Solver backward = {0};
+  push_root_init(&solver->layout, root);
+  solver_push(solver, root);
+  bidirectional_add_goals(solver, &backward);
+
+  Solver *const sides[2] = {solver, &backward};
+  uint32_t heads[2] = {0}, ends[2] = {solver->nodes_len, backward.nodes_len};
+  SolverNode *children = malloc(SOLVER_MAX_SUCCESSORS * sizeof(SolverNode));
+  SDL_assert(children != 0);
+  // Meeting point, as a node index on each side.
+  uint32_t meet[2] = {SOLVER_NO_PARENT, SOLVER_NO_PARENT};
+
+  while (heads[0] < ends[0] && heads[1] < ends[1] &&
+         meet[0] == SOLVER_NO_PARENT && !stats->limit_reached &&
+         !solver_cancelled(solver)) {
+    const uint32_t side = ends[1] - heads[1] < ends[0] - heads[0];
+    const uint32_t tag = side ? BIDIRECTIONAL_BACKWARD : 0;
+    Solver *const nodes = sides[side];
+
+    for (; heads[side] < ends[side] && meet[0] == SOLVER_NO_PARENT;
+         heads[side]++) {
+      const uint32_t head = heads[side];
+      stats->nodes_expanded++;
+      if (solver_cancelled(solver))
+        break;
+      if (solver->nodes_len + backward.nodes_len + SOLVER_MAX_SUCCESSORS >
+          SOLVER_MAX_NODES) {
+        stats->limit_reached = true;
+        break;
+      }
+
+      const uint16_t children_len =
+          side ? pull_successors(&solver->layout, &nodes->nodes[head],
+                                 children)
+               : solver_successors(solver, &nodes->nodes[head], children);
+      for (uint16_t i = 0; i < children_len; i++) {
+        children[i].parent = head;
+        uint32_t *const existing = tt_find(&solver->visited, children[i].hash);
+        if (existing && (*existing & BIDIRECTIONAL_BACKWARD) == tag)
+          continue;
+
+        const uint32_t child_i = solver_append(nodes, &children[i]);
+        if (existing) {
+          meet[side] = child_i;
+          meet[!side] = *existing & ~BIDIRECTIONAL_BACKWARD;
+          break;
+        }
+        tt_insert(&solver->visited, children[i].hash, tag | child_i);
+      }
+    }
+    ends[side] = nodes->nodes_len;
+  }
+
+  if (meet[0] != SOLVER_NO_PARENT)
+    stats->solution =
+        bidirectional_backtrack(solver, &backward, meet[0], meet[1]);
+  free(children);
+  free(backward.nodes);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+// Cells as bitboards, one bit per cell in a `CellSet`, next to the `Entity`
+// cells. Reachability becomes a few word operations per step instead of a
+// loop over every cell.
+//
+// A cell's neighbours are a shift of the set: by 1 across, by the width of the
+// map down. Shifts wrap from one row to the next, which does not matter since
+// the borders of an enclosed level are walls. Sets only use the `words` words
+// of their map, so that small maps pay for small sets.
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "rules.h"
+
+static inline void cellset_remove(CellSet *set, uint32_t cell_i) {
+  bitmap_remove(set->words, cell_i);
+}
+
+// Smallest cell of a non empty set.
+static uint32_t cellset_first(const CellSet *set) {
+  uint8_t w = 0;
+  while (!set->words[w])
+    w++;
+  return w * 64 + __builtin_ctzll(set->words[w]);
+}
+
+// Cells of `open` reached from `seeds`, all in `open`, going across the word
+// either way.
+static uint64_t cellset_word_fill(uint64_t seeds, uint64_t open) {
+  uint64_t up = seeds, down = seeds, up_open = open, down_open = open;
+  for (uint8_t shift = 1; shift < 64; shift *= 2) {
+    up |= up_open & up << shift;
+    up_open &= up_open << shift;
+    down |= down_open & down >> shift;
+    down_open &= down_open >> shift;
+  }
+  return up | down;
+}
+
+// Like `flood_fill()` on the cells of `free`, a map `width` wide: grows the
+// cells reached last, from `from`, one step in every direction and along
+// their word at once, until none is new. Only the words next to them are
+// worked on. Returns the smallest cell reached.
+static uint32_t cellset_flood_fill_scalar(const CellSet *free, uint8_t words,
+                                          uint32_t width, uint32_t from,
+                                          CellSet *reachable) {
+  SDL_assert(free != 0);
+  SDL_assert(reachable != 0);
+  SDL_assert(width < 64);
+
+  __builtin_memset(reachable->words, 0, words * sizeof(uint64_t));
+  cellset_add(reachable, from);
+  // Word `w` at `w + 1`, so that the words on either side of the map read as
+  // zero.
+  uint64_t last[BITMAP_WORDS(MAP_MAX_SIZE) + 2];
+  __builtin_memset(last, 0, (words + 2) * sizeof(uint64_t));
+  last[from / 64 + 1] = reachable->words[from / 64];
+  uint8_t lo = from / 64, hi = lo; // Words of `last` that are not zero.
+  const uint8_t across = width;
+  while (true) {
+    const uint8_t begin = lo ? lo - 1 : 0;
+    const uint8_t end = hi + 1 < words ? hi + 1 : words - 1;
+    lo = end;
+    hi = begin;
+    bool grew = false;
+    // Each word replaced once its neighbours have read it.
+    uint64_t before = last[begin];
+    for (uint8_t w = begin; w <= end; w++) {
+      const uint64_t here = last[w + 1], after = last[w + 2];
+      if (!(before | here | after))
+        continue; // `before` is already zero, like `here`.
+      const uint64_t next = here << 1 | before >> 63 | here >> 1 |
+                            after << 63 | here << across |
+                            before >> (64 - across) | here >> across |
+                            after << (64 - across);
+      const uint64_t open = free->words[w] & ~reachable->words[w];
+      const uint64_t grown = cellset_word_fill(next & open, open);
+      last[w + 1] = grown;
+      reachable->words[w] |= grown;
+      before = here;
+      if (grown) {
+        lo = w < lo ? w : lo;
+        hi = w;
+        grew = true;
+      }
+    }
+    if (!grew)
+      break;
+  }
+  return cellset_first(reachable);
+}
+
+#ifdef __AVX2__
+// Sets of up to this many words fit in one register, the words past the map
+// zero.
+#define CELLSET_AVX2_WORDS 4
+SDL_COMPILE_TIME_ASSERT(cellset_avx2_loads,
+                        BITMAP_WORDS(MAP_MAX_SIZE) >= CELLSET_AVX2_WORDS);
+
+// The first `words` words of `set`, the others zero.
+static __m256i cellset_load(const CellSet *set, uint8_t words) {
+  const __m256i used = _mm256_cmpgt_epi64(_mm256_set1_epi64x(words),
+                                          _mm256_setr_epi64x(0, 1, 2, 3));
+  return _mm256_and_si256(_mm256_loadu_si256((const __m256i *)set->words),
+                          used);
+}
+
+// Cells moved `shift` down: each word shifted, with the bits that fall off
+// carried into the next word.
+static __m256i cellset_avx2_down(__m256i set, int shift) {
+  const __m256i carry = _mm256_permute4x64_epi64(
+      _mm256_srli_epi64(set, 64 - shift), _MM_SHUFFLE(2, 1, 0, 3));
+  return _mm256_or_si256(
+      _mm256_slli_epi64(set, shift),
+      _mm256_blend_epi32(carry, _mm256_setzero_si256(), 0x03));
+}
+
+static __m256i cellset_avx2_up(__m256i set, int shift) {
+  const __m256i carry = _mm256_permute4x64_epi64(
+      _mm256_slli_epi64(set, 64 - shift), _MM_SHUFFLE(0, 3, 2, 1));
+  return _mm256_or_si256(
+      _mm256_srli_epi64(set, shift),
+      _mm256_blend_epi32(carry, _mm256_setzero_si256(), 0xc0));
+}
+
+// `cellset_flood_fill_scalar()` with AVX2, for sets of up to
+// `CELLSET_AVX2_WORDS` words.
+static uint32_t cellset_flood_fill_avx2(const CellSet *free, uint8_t words,
+                                        uint32_t width, uint32_t from,
+                                        CellSet *reachable) {
+  SDL_assert(free != 0);
+  SDL_assert(reachable != 0);
+  SDL_assert(words <= CELLSET_AVX2_WORDS);
+
+  const __m256i mask = cellset_load(free, words);
+  // Only `from`: its bit, in its word.
+  __m256i set = _mm256_and_si256(
+      _mm256_set1_epi64x((int64_t)((uint64_t)1 << from % 64)),
+      _mm256_cmpeq_epi64(_mm256_set1_epi64x(from / 64),
+                         _mm256_setr_epi64x(0, 1, 2, 3)));
+  while (true) {
+    __m256i next = _mm256_or_si256(set, cellset_avx2_down(set, 1));
+    next = _mm256_or_si256(next, cellset_avx2_up(set, 1));
+    next = _mm256_or_si256(next, cellset_avx2_down(set, (int)width));
+    next = _mm256_or_si256(next, cellset_avx2_up(set, (int)width));
+    next = _mm256_and_si256(next, mask);
+    const __m256i changed = _mm256_xor_si256(next, set);
+    set = next;
+    if (_mm256_testz_si256(changed, changed))
+      break;
+  }
+
+  // The words past the map are zero: a `CellSet` has room for them.
+  _mm256_storeu_si256((__m256i *)reachable->words, set);
+  return cellset_first(reachable);
+}
+#endif
+
+// The fastest flood fill this machine was built for.
+static inline uint32_t cellset_flood_fill(const CellSet *free,
+                                          uint8_t words, uint32_t width,
+                                          uint32_t from, CellSet *reachable) {
+#ifdef __AVX2__
+  if (words <= CELLSET_AVX2_WORDS)
+    return cellset_flood_fill_avx2(free, words, width, from, reachable);
+#endif
+  return cellset_flood_fill_scalar(free, words, width, from, reachable);
+}
+
+// Walls of `map`, of `size` cells. Cells past the map count as walls.
+static inline void cellset_walls(const Entity *map, uint32_t size,
+                                 CellSet *walls) {
+  SDL_assert(map != 0);
+  SDL_assert(walls != 0);
+  SDL_assert(size <= MAP_MAX_SIZE);
+
+  *walls = (CellSet){0};
+  for (uint32_t i = size; i < BITMAP_WORDS(size) * 64; i++)
+    cellset_add(walls, i);
+  for (uint32_t i = 0; i < size; i++) {
+    if (bitset_contains(map[i], ENTITY_WALL))
+      cellset_add(walls, i);
+  }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// Deadlocks created by a push, checked right after it so that they stay cheap
+// enough for every node of a search.
+
+#include "rules.h"
+
+// A crate is frozen when it can move neither horizontally nor vertically. On
+// one axis, it is blocked by a wall, by two dead squares, or by a crate that
+// is frozen itself. Crates whose check is under way count as walls to break
+// cycles: a crate found frozen against one of them is only frozen if that one
+// is too, so its result only counts for the crate that asked for it. When
+// frozen, `*off_objective` tells whether it or a crate it is frozen against,
+// on either axis and whatever blocked it, is not on an objective. `visited` is
+// left as it was. On maps of any size, with their `neighbours` offsets (see
+// `map_neighbours()`).
+static bool crate_is_frozen(const Entity *map, const int32_t *neighbours,
+                            const uint64_t *dead_squares, uint32_t crate_i,
+                            uint64_t *visited, bool *off_objective) {
+  bitmap_add(visited, crate_i);
+
+  bool blocked[2] = {0};
+  bool checked[4] = {0}; // By direction of the crate next to this one.
+  bool off = !bitset_contains(map[crate_i], ENTITY_OBJECTIVE);
+  for (Direction dir = DIR_UP; dir <= DIR_RIGHT; dir++) {
+    const uint32_t a = crate_i + neighbours[dir];
+    const uint32_t b = crate_i + neighbours[direction_opposite(dir)];
+
+    if (bitset_contains(map[a], ENTITY_WALL) ||
+        bitset_contains(map[b], ENTITY_WALL) || bitmap_contains(visited, a) ||
+        bitmap_contains(visited, b) ||
+        (bitmap_contains(dead_squares, a) &&
+         bitmap_contains(dead_squares, b))) {
+      blocked[dir] = true;
+      continue;
+    }
+
+    const Direction sides[2] = {dir, direction_opposite(dir)};
+    for (uint8_t s = 0; s < 2 && !blocked[dir]; s++) {
+      const uint32_t side = crate_i + neighbours[sides[s]];
+      bool side_off = false;
+      checked[sides[s]] = true;
+      blocked[dir] = bitset_contains(map[side], ENTITY_CRATE) &&
+                     crate_is_frozen(map, neighbours, dead_squares, side,
+                                     visited, &side_off);
+      off |= blocked[dir] && side_off;
+    }
+  }
+
+  // Crates next to this one on an axis blocked otherwise, say by a wall on
+  // the other side, are frozen with it too if they cannot move either.
+  const bool frozen = blocked[DIR_UP] && blocked[DIR_RIGHT];
+  for (Direction dir = DIR_UP; frozen && !off && dir <= DIR_LEFT; dir++) {
+    const uint32_t side = crate_i + neighbours[dir];
+    if (checked[dir] || !bitset_contains(map[side], ENTITY_CRATE) ||
+        bitmap_contains(visited, side))
+      continue;
+
+    bool side_off = false;
+    off = crate_is_frozen(map, neighbours, dead_squares, side, visited,
+                          &side_off) &&
+          side_off;
+  }
+  bitmap_remove(visited, crate_i);
+
+  *off_objective = frozen && off;
+  return frozen;
+}
+
+// Whether the crate just pushed onto `crate_i` makes the level unsolvable, on
+// a map of any size. `visited` is zeroed scratch space, as long as
+// `dead_squares`, and is left zeroed.
+static bool push_is_deadlock_by(const Entity *map, const int32_t *neighbours,
+                                const uint64_t *dead_squares,
+                                uint64_t *visited, uint32_t crate_i) {
+  SDL_assert(map != 0);
+  SDL_assert(neighbours != 0);
+  SDL_assert(dead_squares != 0);
+  SDL_assert(visited != 0);
+  SDL_assert(bitset_contains(map[crate_i], ENTITY_CRATE));
+
+  if (bitmap_contains(dead_squares, crate_i))
+    return true;
+
+  bool off_objective = false;
+  return crate_is_frozen(map, neighbours, dead_squares, crate_i, visited,
+                         &off_objective) &&
+         off_objective;
+}
+
+// `push_is_deadlock_by()` for the solver, on a map of at most `MAP_MAX_SIZE`
+// cells, `words` words of a `CellSet`.
+static inline bool push_is_deadlock(const Entity *map,
+                                    const int32_t *neighbours, uint8_t words,
+                                    const CellSet *dead_squares,
+                                    uint32_t crate_i) {
+  SDL_assert(dead_squares != 0);
+
+  CellSet visited;
+  __builtin_memset(visited.words, 0, words * sizeof(uint64_t));
+  return push_is_deadlock_by(map, neighbours, dead_squares->words,
+                             visited.words, crate_i);
+}
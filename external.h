@@ -0,0 +1,376 @@
+#pragma once
+
+// Push-level breadth-first search with delayed duplicate detection, for
+// levels whose visited states do not fit in memory.
+//
+// States are stored on disk as `VisitedKey`s (see `push_state_key()`) in a
+// temporary directory. Expanding a layer streams its file and buffers the
+// children in memory; whenever the buffer is full, it is sorted and written
+// as a run. The runs are then merged, and the merge is subtracted from the
+// sorted file of every state seen so far: what is left is the next layer, and
+// the union becomes the new visited file. Only the child buffer lives in
+// memory, hence the RAM budget.
+//
+// Layers are kept until the end: the solution is rebuilt by scanning them,
+// last first, for a parent of the state found so far. Push-optimal.
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "search.h"
+#include "visited.h"
+
+// Runs merged at once; more take several passes.
+#define EXTERNAL_MAX_RUNS 64
+#define EXTERNAL_IO_BUFFER (1 << 20)
+#define EXTERNAL_PATH_MAX 512
+
+typedef struct {
+  Solver *solver;
+  char dir[EXTERNAL_PATH_MAX - 32]; // Room for the file names.
+  VisitedKey *buffer;
+  size_t buffer_len, buffer_cap;
+  uint32_t runs_first, runs_end; // Run files not merged yet.
+  SolverNode *children;
+  bool failed;
+} ExternalSearch;
+
+typedef struct {
+  FILE *file;
+  VisitedKey key;
+  bool ok; // `key` holds the next record.
+} ExternalReader;
+
+typedef struct {
+  ExternalReader readers[EXTERNAL_MAX_RUNS];
+  uint32_t len;
+  VisitedKey last;
+  bool started;
+} ExternalMerge;
+
+static int external_compare_keys(VisitedKey a, VisitedKey b) {
+  if (a.hi != b.hi)
+    return a.hi < b.hi ? -1 : 1;
+  if (a.lo != b.lo)
+    return a.lo < b.lo ? -1 : 1;
+  return 0;
+}
+
+static int external_compare(const void *a, const void *b) {
+  return external_compare_keys(*(const VisitedKey *)a,
+                               *(const VisitedKey *)b);
+}
+
+static void external_path(const ExternalSearch *ext, const char *name,
+                          uint32_t i, char *path) {
+  snprintf(path, EXTERNAL_PATH_MAX, "%s/%s-%u", ext->dir, name, i);
+}
+
+static FILE *external_open(ExternalSearch *ext, const char *name, uint32_t i,
+                           const char *mode) {
+  char path[EXTERNAL_PATH_MAX];
+  external_path(ext, name, i, path);
+  FILE *file = fopen(path, mode);
+  if (!file) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    ext->failed = true;
+    return 0;
+  }
+  setvbuf(file, 0, _IOFBF, EXTERNAL_IO_BUFFER);
+  return file;
+}
+
+static void external_close(ExternalSearch *ext, FILE *file) {
+  if (ferror(file) | fclose(file)) {
+    fprintf(stderr, "Failed to write to %s\n", ext->dir);
+    ext->failed = true;
+  }
+}
+
+static void external_remove(const ExternalSearch *ext, const char *name,
+                            uint32_t i) {
+  char path[EXTERNAL_PATH_MAX];
+  external_path(ext, name, i, path);
+  remove(path);
+}
+
+static void external_write(FILE *file, VisitedKey key) {
+  fwrite(&key, sizeof(key), 1, file);
+}
+
+static void external_read(ExternalReader *reader) {
+  reader->ok = reader->file &&
+               fread(&reader->key, sizeof(reader->key), 1, reader->file) == 1;
+}
+
+// Sort the buffered children and write them as a new run.
+static void external_flush_run(ExternalSearch *ext) {
+  if (ext->buffer_len == 0)
+    return;
+
+  qsort(ext->buffer, ext->buffer_len, sizeof(VisitedKey), external_compare);
+  FILE *run = external_open(ext, "run", ext->runs_end++, "wb");
+  if (run) {
+    for (size_t i = 0; i < ext->buffer_len; i++) {
+      if (i == 0 ||
+          external_compare_keys(ext->buffer[i - 1], ext->buffer[i]) != 0)
+        external_write(run, ext->buffer[i]);
+    }
+    external_close(ext, run);
+  }
+  ext->buffer_len = 0;
+}
+
+static void external_merge_open(ExternalSearch *ext, ExternalMerge *merge,
+                                uint32_t first, uint32_t len) {
+  SDL_assert(len <= EXTERNAL_MAX_RUNS);
+
+  *merge = (ExternalMerge){.len = len};
+  for (uint32_t r = 0; r < len; r++) {
+    merge->readers[r].file = external_open(ext, "run", first + r, "rb");
+    external_read(&merge->readers[r]);
+  }
+}
+
+// Next key over all the runs, each only once. Returns false at the end.
+static bool external_merge_next(ExternalMerge *merge, VisitedKey *key) {
+  while (true) {
+    ExternalReader *min = 0;
+    for (uint32_t r = 0; r < merge->len; r++) {
+      ExternalReader *const reader = &merge->readers[r];
+      if (reader->ok &&
+          (!min || external_compare_keys(reader->key, min->key) < 0))
+        min = reader;
+    }
+    if (!min)
+      return false;
+
+    *key = min->key;
+    external_read(min);
+    if (merge->started && external_compare_keys(merge->last, *key) == 0)
+      continue;
+
+    merge->started = true;
+    merge->last = *key;
+    return true;
+  }
+}
+
+static void external_merge_close(ExternalSearch *ext, ExternalMerge *merge,
+                                 uint32_t first) {
+  for (uint32_t r = 0; r < merge->len; r++) {
+    if (merge->readers[r].file)
+      fclose(merge->readers[r].file);
+    external_remove(ext, "run", first + r);
+  }
+}
+
+// Merge runs together until at most `EXTERNAL_MAX_RUNS` are left.
+static void external_reduce_runs(ExternalSearch *ext) {
+  while (ext->runs_end - ext->runs_first > EXTERNAL_MAX_RUNS &&
+         !ext->failed) {
+    ExternalMerge merge;
+    external_merge_open(ext, &merge, ext->runs_first, EXTERNAL_MAX_RUNS);
+    FILE *run = external_open(ext, "run", ext->runs_end++, "wb");
+    VisitedKey key;
+    while (run && external_merge_next(&merge, &key))
+      external_write(run, key);
+    if (run)
+      external_close(ext, run);
+    external_merge_close(ext, &merge, ext->runs_first);
+    ext->runs_first += EXTERNAL_MAX_RUNS;
+  }
+}
+
+// Expand every state of `layer` into runs of children.
+static void external_expand(ExternalSearch *ext, uint32_t layer,
+                            SolverStats *stats) {
+  Solver *const solver = ext->solver;
+  ExternalReader reader = {.file = external_open(ext, "layer", layer, "rb")};
+  for (external_read(&reader); reader.ok; external_read(&reader)) {
+    const SolverNode node = push_state_from_key(reader.key);
+    stats->nodes_expanded++;
+
+    const uint16_t children_len =
+        solver_successors(solver, &node, ext->children);
+    if (ext->buffer_len + children_len > ext->buffer_cap)
+      external_flush_run(ext);
+    for (uint16_t i = 0; i < children_len; i++)
+      ext->buffer[ext->buffer_len++] = push_state_key(&ext->children[i]);
+  }
+  if (reader.file)
+    fclose(reader.file);
+  external_flush_run(ext);
+  external_reduce_runs(ext);
+}
+
+// Write the children not visited yet as `layer`, and merge them into the
+// visited file. Returns the size of the layer; `won` is set to a solved
+// state of it, if any.
+static uint64_t external_next_layer(ExternalSearch *ext, uint32_t layer,
+                                    VisitedKey *won, bool *solved) {
+  ExternalMerge merge;
+  external_merge_open(ext, &merge, ext->runs_first,
+                      ext->runs_end - ext->runs_first);
+  ExternalReader visited = {.file = external_open(ext, "visited", 0, "rb")};
+  external_read(&visited);
+  FILE *visited_out = external_open(ext, "visited", 1, "wb");
+  FILE *layer_out = external_open(ext, "layer", layer, "wb");
+
+  uint64_t layer_len = 0;
+  VisitedKey key;
+  while (visited_out && layer_out && external_merge_next(&merge, &key)) {
+    while (visited.ok && external_compare_keys(visited.key, key) < 0) {
+      external_write(visited_out, visited.key);
+      external_read(&visited);
+    }
+    if (visited.ok && external_compare_keys(visited.key, key) == 0)
+      continue;
+
+    external_write(visited_out, key);
+    external_write(layer_out, key);
+    layer_len++;
+    const SolverNode node = push_state_from_key(key);
+    if (!*solved && packed_is_won(&ext->solver->layout, &node.state)) {
+      *won = key;
+      *solved = true;
+    }
+  }
+  for (; visited_out && visited.ok; external_read(&visited))
+    external_write(visited_out, visited.key);
+
+  external_merge_close(ext, &merge, ext->runs_first);
+  ext->runs_first = ext->runs_end;
+  if (visited.file)
+    fclose(visited.file);
+  if (visited_out)
+    external_close(ext, visited_out);
+  if (layer_out)
+    external_close(ext, layer_out);
+
+  char from[EXTERNAL_PATH_MAX], to[EXTERNAL_PATH_MAX];
+  external_path(ext, "visited", 1, from);
+  external_path(ext, "visited", 0, to);
+  if (!ext->failed && rename(from, to) != 0) {
+    fprintf(stderr, "Failed to rename %s: %s\n", from, strerror(errno));
+    ext->failed = true;
+  }
+  return layer_len;
+}
+
+// Find, layer by layer from the last one, the pushes that lead to `won`.
+static char *external_backtrack(ExternalSearch *ext, const SolverNode *root,
+                                uint32_t layers, VisitedKey won) {
+  Solver *const solver = ext->solver;
+  SolverNode *path = malloc((layers + 1) * sizeof(SolverNode));
+  SDL_assert(path != 0);
+  path[0] = *root;
+
+  VisitedKey target = won;
+  for (uint32_t layer = layers; layer > 0 && !ext->failed; layer--) {
+    ExternalReader reader = {
+        .file = external_open(ext, "layer", layer - 1, "rb")};
+    bool found = false;
+    for (external_read(&reader); reader.ok && !found; external_read(&reader)) {
+      const SolverNode node = push_state_from_key(reader.key);
+      const uint16_t children_len =
+          solver_successors(solver, &node, ext->children);
+      for (uint16_t i = 0; i < children_len && !found; i++) {
+        if (external_compare_keys(push_state_key(&ext->children[i]),
+                                  target) != 0)
+          continue;
+
+        path[layer] = ext->children[i];
+        target = reader.key;
+        found = true;
+      }
+    }
+    if (reader.file)
+      fclose(reader.file);
+    SDL_assert(found || ext->failed);
+  }
+
+  char *solution = 0;
+  if (!ext->failed) {
+    const SolverNode **nodes = malloc((layers + 1) * sizeof(SolverNode *));
+    SDL_assert(nodes != 0);
+    for (uint32_t i = 0; i <= layers; i++)
+      nodes[i] = &path[i];
+    solution = solution_from_pushes(&solver->layout, nodes, layers);
+    free(nodes);
+  }
+  free(path);
+  return solution;
+}
+
+static void solve_external(Solver *solver, SolverNode *root,
+                           const char *tmp_dir, size_t ram_bytes,
+                           SolverStats *stats) {
+  SDL_assert(tmp_dir != 0);
+
+  if (!push_state_key_fits(&solver->layout))
+    return;
+  push_root_init(&solver->layout, root);
+  if (packed_is_won(&solver->layout, &root->state)) {
+    stats->solution = calloc(1, 1);
+    return;
+  }
+
+  ExternalSearch ext = {.solver = solver};
+  if (snprintf(ext.dir, sizeof(ext.dir), "%s/sokoban-XXXXXX",
+               tmp_dir) >= (int)sizeof(ext.dir) ||
+      !mkdtemp(ext.dir)) {
+    fprintf(stderr, "Failed to create a directory in %s\n", tmp_dir);
+    return;
+  }
+  ext.buffer_cap = ram_bytes / sizeof(VisitedKey);
+  if (ext.buffer_cap < SOLVER_MAX_SUCCESSORS)
+    ext.buffer_cap = SOLVER_MAX_SUCCESSORS;
+  ext.buffer = malloc(ext.buffer_cap * sizeof(VisitedKey));
+  ext.children = malloc(SOLVER_MAX_SUCCESSORS * sizeof(SolverNode));
+  SDL_assert(ext.buffer != 0);
+  SDL_assert(ext.children != 0);
+
+  // The root alone is both the first layer and every state visited so far.
+  FILE *file = external_open(&ext, "layer", 0, "wb");
+  if (file) {
+    external_write(file, push_state_key(root));
+    external_close(&ext, file);
+  }
+  file = external_open(&ext, "visited", 0, "wb");
+  if (file) {
+    external_write(file, push_state_key(root));
+    external_close(&ext, file);
+  }
+
+  const double start = now_s();
+  uint64_t visited_len = 1;
+  uint32_t layers = 0;
+  VisitedKey won;
+  bool solved = false;
+  while (!solved && !ext.failed && !solver_cancelled(solver)) {
+    external_expand(&ext, layers, stats);
+    const uint64_t layer_len =
+        external_next_layer(&ext, layers + 1, &won, &solved);
+    layers++;
+    visited_len += layer_len;
+    fprintf(stderr, "Layer %u: %llu states, %llu visited, %.1f s\n", layers,
+            (unsigned long long)layer_len, (unsigned long long)visited_len,
+            now_s() - start);
+    if (layer_len == 0)
+      break;
+  }
+
+  if (solved && !ext.failed)
+    stats->solution = external_backtrack(&ext, root, layers, won);
+
+  for (uint32_t layer = 0; layer <= layers; layer++)
+    external_remove(&ext, "layer", layer);
+  external_remove(&ext, "visited", 0);
+  external_remove(&ext, "visited", 1);
+  for (uint32_t run = ext.runs_first; run < ext.runs_end; run++)
+    external_remove(&ext, "run", run);
+  rmdir(ext.dir);
+  free(ext.buffer);
+  free(ext.children);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// Binary min-heap of 64 bit keys, for the best-first searches. Callers pack
+// their priority in the high bits and an index in the low ones.
+
+#include <stdlib.h>
+
+#include "rules.h"
+
+typedef struct {
+  uint64_t *items;
+  uint32_t len, cap;
+} NodeHeap;
+
+static void node_heap_push(NodeHeap *heap, uint64_t key) {
+  if (heap->len == heap->cap) {
+    heap->cap = heap->cap ? heap->cap * 2 : 1 << 12;
+    heap->items = realloc(heap->items, heap->cap * sizeof(uint64_t));
+    SDL_assert(heap->items != 0);
+  }
+
+  uint32_t i = heap->len++;
+  while (i > 0 && heap->items[(i - 1) / 2] > key) {
+    heap->items[i] = heap->items[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap->items[i] = key;
+}
+
+static uint64_t node_heap_pop(NodeHeap *heap) {
+  SDL_assert(heap->len > 0);
+
+  const uint64_t top = heap->items[0];
+  const uint64_t last = heap->items[--heap->len];
+  uint32_t i = 0;
+  while (true) {
+    uint32_t child = 2 * i + 1;
+    if (child >= heap->len)
+      break;
+    if (child + 1 < heap->len && heap->items[child + 1] < heap->items[child])
+      child++;
+    if (heap->items[child] >= last)
+      break;
+    heap->items[i] = heap->items[child];
+    i = child;
+  }
+  if (heap->len > 0)
+    heap->items[i] = last;
+  return top;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+// Lower bound on the pushes left: a minimum cost perfect matching between
+// crates and objectives (Hungarian algorithm), where the cost of a pair is the
+// number of pushes to bring the crate there if it were alone on the map.
+// Pairs the crate can never reach cost `HEURISTIC_INFINITE`, so a matching that
+// needs one of them proves a deadlock.
+//
+// When a single crate moves, only its row of the cost matrix changes: the
+// matching is repaired with one augmenting path (O(n²)) instead of being
+// solved again (O(n³)). Searches keep the matching of each node, packed, to
+// repair it for the children when the node is expanded.
+
+#include "packed.h"
+
+#define HEURISTIC_INFINITE UINT16_MAX
+
+typedef struct {
+  // Objectives are never dead squares: each has a packed bit.
+  uint16_t objectives[PACKED_MAX_CELLS];
+  uint8_t objectives_len;
+  // By cell, then by objective index. Heap allocated.
+  uint16_t *distance;
+} PushDistances;
+
+static uint16_t *push_distance(const PushDistances *d, uint32_t cell_i,
+                               uint8_t objective) {
+  return &d->distance[cell_i * d->objectives_len + objective];
+}
+
+// Pull a crate backwards from every objective, like `find_dead_squares()`,
+// but breadth first to get distances.
+static void compute_push_distances(const PackedLayout *layout,
+                                   const Entity *map, PushDistances *d) {
+  SDL_assert(layout != 0);
+  SDL_assert(map != 0);
+  SDL_assert(d != 0);
+
+  d->objectives_len = 0;
+  for (uint32_t i = 0; i < layout->size; i++) {
+    if (bitset_contains(map[i], ENTITY_OBJECTIVE))
+      d->objectives[d->objectives_len++] = i;
+  }
+  d->distance =
+      malloc((size_t)layout->size * d->objectives_len * sizeof(uint16_t));
+  SDL_assert(d->distance != 0 || d->objectives_len == 0);
+
+  for (uint8_t o = 0; o < d->objectives_len; o++) {
+    for (uint32_t i = 0; i < layout->size; i++)
+      *push_distance(d, i, o) = HEURISTIC_INFINITE;
+
+    uint16_t queue[MAP_MAX_SIZE];
+    uint32_t queue_head = 0, queue_len = 0;
+    *push_distance(d, d->objectives[o], o) = 0;
+    queue[queue_len++] = d->objectives[o];
+    while (queue_head < queue_len) {
+      const uint32_t cell_i = queue[queue_head++];
+      for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+        const uint32_t from_i = cell_i + layout->neighbours[dir];
+        const uint32_t character_i = from_i + layout->neighbours[dir];
+        if (*push_distance(d, from_i, o) != HEURISTIC_INFINITE ||
+            bitset_contains(map[from_i], ENTITY_WALL) ||
+            bitset_contains(map[character_i], ENTITY_WALL))
+          continue;
+
+        *push_distance(d, from_i, o) = *push_distance(d, cell_i, o) + 1;
+        queue[queue_len++] = from_i;
+      }
+    }
+  }
+}
+
+static void push_distances_destroy(PushDistances *d) {
+  SDL_assert(d != 0);
+
+  free(d->distance);
+  d->distance = 0;
+}
+
+// Rows are crates, columns objectives, both 1-indexed as in the usual
+// formulation of the algorithm; row and column 0 are scratch space.
+typedef struct {
+  uint16_t crates[PACKED_MAX_CELLS + 1];
+  uint8_t len;
+  int32_t u[PACKED_MAX_CELLS + 1], v[PACKED_MAX_CELLS + 1]; // Potentials.
+  uint8_t row_of[PACKED_MAX_CELLS + 1]; // Row matched to a column.
+} Matching;
+
+static int32_t matching_cell_cost(const Matching *m, const PushDistances *d,
+                                  uint8_t row, uint8_t column) {
+  return *push_distance(d, m->crates[row], column - 1);
+}
+
+// Match `row`, currently unmatched, keeping the potentials feasible.
+static void matching_augment(Matching *m, const PushDistances *d,
+                             uint8_t row) {
+  int32_t min_slack[PACKED_MAX_CELLS + 1];
+  uint8_t way[PACKED_MAX_CELLS + 1];
+  bool used[PACKED_MAX_CELLS + 1];
+  for (uint8_t j = 0; j <= m->len; j++) {
+    min_slack[j] = INT32_MAX;
+    used[j] = false;
+  }
+
+  uint8_t column = 0;
+  m->row_of[0] = row;
+  do {
+    used[column] = true;
+    const uint8_t i = m->row_of[column];
+    int32_t delta = INT32_MAX;
+    uint8_t next_column = 0;
+    for (uint8_t j = 1; j <= m->len; j++) {
+      if (used[j])
+        continue;
+
+      const int32_t slack = matching_cell_cost(m, d, i, j) - m->u[i] - m->v[j];
+      if (slack < min_slack[j]) {
+        min_slack[j] = slack;
+        way[j] = column;
+      }
+      if (min_slack[j] < delta) {
+        delta = min_slack[j];
+        next_column = j;
+      }
+    }
+    for (uint8_t j = 0; j <= m->len; j++) {
+      if (used[j]) {
+        m->u[m->row_of[j]] += delta;
+        m->v[j] -= delta;
+      } else {
+        min_slack[j] -= delta;
+      }
+    }
+    column = next_column;
+  } while (m->row_of[column] != 0);
+
+  do {
+    const uint8_t previous = way[column];
+    m->row_of[column] = m->row_of[previous];
+    column = previous;
+  } while (column != 0);
+}
+
+// Solve from scratch for `map`, of `size` cells. Only defined when there are
+// as many crates as objectives.
+static void matching_init(Matching *m, const PushDistances *d,
+                          const Entity *map, uint32_t size) {
+  SDL_assert(m != 0);
+  SDL_assert(d != 0);
+  SDL_assert(map != 0);
+
+  m->len = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (bitset_contains(map[i], ENTITY_CRATE))
+      m->crates[++m->len] = i;
+  }
+  SDL_assert(m->len == d->objectives_len);
+
+  for (uint8_t j = 0; j <= m->len; j++) {
+    m->u[j] = m->v[j] = 0;
+    m->row_of[j] = 0;
+  }
+  for (uint8_t i = 1; i <= m->len; i++)
+    matching_augment(m, d, i);
+}
+
+static void matching_move_crate(Matching *m, const PushDistances *d,
+                                uint32_t from, uint32_t to) {
+  SDL_assert(m != 0);
+  SDL_assert(d != 0);
+
+  uint8_t row = 1;
+  while (m->crates[row] != from)
+    row++;
+  SDL_assert(row <= m->len);
+  m->crates[row] = to;
+
+  // Unmatch the row, then lower its potential so that it is feasible again
+  // with the new costs. Every other matched pair stays tight.
+  for (uint8_t j = 1; j <= m->len; j++) {
+    if (m->row_of[j] == row)
+      m->row_of[j] = 0;
+  }
+  int32_t u = INT32_MAX;
+  for (uint8_t j = 1; j <= m->len; j++) {
+    const int32_t reduced = matching_cell_cost(m, d, row, j) - m->v[j];
+    if (reduced < u)
+      u = reduced;
+  }
+  m->u[row] = u;
+  matching_augment(m, d, row);
+}
+
+// Bytes of a packed matching of `len` crates: the crate matched to each
+// objective, and the potential of the objective. The potentials of the crates
+// follow, as every matched pair is tight.
+static size_t matching_packed_size(uint8_t len) {
+  return len * (sizeof(uint16_t) + sizeof(int32_t));
+}
+
+static void matching_pack(const Matching *m, uint8_t *out) {
+  SDL_assert(m != 0);
+  SDL_assert(out != 0);
+
+  for (uint8_t j = 1; j <= m->len; j++) {
+    const uint16_t crate_i = m->crates[m->row_of[j]];
+    __builtin_memcpy(out, &crate_i, sizeof(crate_i));
+    out += sizeof(crate_i);
+  }
+  __builtin_memcpy(out, &m->v[1], m->len * sizeof(int32_t));
+}
+
+// Row `j` is matched to column `j`.
+static void matching_unpack(Matching *m, const PushDistances *d,
+                            const uint8_t *in) {
+  SDL_assert(m != 0);
+  SDL_assert(d != 0);
+  SDL_assert(in != 0);
+
+  m->len = d->objectives_len;
+  m->u[0] = m->v[0] = 0;
+  m->row_of[0] = 0;
+  __builtin_memcpy(&m->crates[1], in, m->len * sizeof(uint16_t));
+  __builtin_memcpy(&m->v[1], in + m->len * sizeof(uint16_t),
+                   m->len * sizeof(int32_t));
+  for (uint8_t j = 1; j <= m->len; j++) {
+    m->row_of[j] = j;
+    m->u[j] = matching_cell_cost(m, d, j, j) - m->v[j];
+  }
+}
+
+// Total cost, or `HEURISTIC_INFINITE` when some crate cannot reach its
+// objective.
+static uint32_t matching_cost(const Matching *m, const PushDistances *d) {
+  uint32_t cost = 0;
+  for (uint8_t j = 1; j <= m->len; j++) {
+    const uint32_t c = matching_cell_cost(m, d, m->row_of[j], j);
+    if (c >= HEURISTIC_INFINITE)
+      return HEURISTIC_INFINITE;
+    cost += c;
+  }
+  return cost;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+// Hints for the game: the next move of a solution from the current position.
+//
+// A worker thread runs the solver so that the event loop never waits on it.
+// It is handed the latest requested position, and posts an event of type
+// `HintEngine.event_type` when done. Every position along the solution found
+// is cached by its hash, with its next move: following a hint, or going back
+// to a position already solved, gets the next one at once.
+
+#include <pthread.h>
+
+#include "solver.h"
+#include "zobrist.h"
+
+// Enough for the levels that fit in the window.
+#define HINT_RAM_BYTES ((size_t)64 << 20)
+#define HINT_CACHE_BYTES ((size_t)1 << 20)
+// Cached for positions with no solution, or where the solver gave up.
+#define HINT_NONE 0
+#define HINT_GAVE_UP 1
+
+typedef struct {
+  uint32_t width, height, size; // Of the level.
+  int32_t neighbours[4];
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t requested_cond;
+  // Under `lock`.
+  TranspositionTable cache; // Next LURD move, by `zobrist_hash()`.
+  Entity request[MAP_MAX_SIZE];
+  bool requested;
+  uint32_t event_type;
+} HintEngine;
+
+static uint32_t hint_character_cell(const Entity *map) {
+  uint32_t character_cell_i = 0;
+  while (!bitset_contains(map[character_cell_i], ENTITY_CHARACTER))
+    character_cell_i++;
+  return character_cell_i;
+}
+
+// Cache the next move of every position of `solution`, played from `map`.
+static void hint_cache_solution(HintEngine *hint, const Entity *map,
+                                const char *solution) {
+  Entity replay[MAP_MAX_SIZE];
+  __builtin_memcpy(replay, map, hint->size);
+  uint32_t character_cell_i = hint_character_cell(map);
+
+  pthread_mutex_lock(&hint->lock);
+  for (const char *move = solution; *move; move++) {
+    const uint64_t hash = zobrist_hash(replay, hint->size, character_cell_i);
+    uint32_t *const cached = tt_find(&hint->cache, hash);
+    if (cached)
+      *cached = (uint32_t)*move;
+    else
+      tt_insert(&hint->cache, hash, (uint32_t)*move);
+    go_by(hint->neighbours[direction_from_lurd(*move)], &character_cell_i,
+          replay);
+  }
+  pthread_mutex_unlock(&hint->lock);
+}
+
+static void *hint_run(void *arg) {
+  HintEngine *const hint = arg;
+  const SolverOptions options = {
+      .mode = SEARCH_ASTAR, .threads = 1, .ram_bytes = HINT_RAM_BYTES};
+  while (true) {
+    Entity map[MAP_MAX_SIZE];
+    pthread_mutex_lock(&hint->lock);
+    while (!hint->requested)
+      pthread_cond_wait(&hint->requested_cond, &hint->lock);
+    __builtin_memcpy(map, hint->request, hint->size);
+    hint->requested = false;
+    pthread_mutex_unlock(&hint->lock);
+
+    SolverStats stats;
+    solve(map, hint->width, hint->height, &options, &stats);
+    if (stats.solution && *stats.solution) {
+      hint_cache_solution(hint, map, stats.solution);
+    } else {
+      pthread_mutex_lock(&hint->lock);
+      tt_insert(&hint->cache,
+                zobrist_hash(map, hint->size, hint_character_cell(map)),
+                stats.limit_reached ? HINT_GAVE_UP : HINT_NONE);
+      pthread_mutex_unlock(&hint->lock);
+    }
+    free(stats.solution);
+
+    SDL_Event event = {.type = hint->event_type};
+    SDL_PushEvent(&event);
+  }
+  return 0;
+}
+
+// Hints for the level `map`, `width` by `height` cells, in its initial
+// position. Returns false if the solver does not take it: too large, or with
+// too many cells to pack a state, every hint would be a failure.
+static bool hint_init(HintEngine *hint, const Entity *map, uint32_t width,
+                      uint32_t height) {
+  SDL_assert(hint != 0);
+  SDL_assert(map != 0);
+
+  PackedLayout layout;
+  CellSet dead_squares;
+  if (!packed_layout_init(&layout, map, width, height, &dead_squares))
+    return false;
+
+  *hint = (HintEngine){
+      .width = width, .height = height, .size = width * height};
+  map_neighbours(width, hint->neighbours);
+  hint->event_type = SDL_RegisterEvents(1);
+  if (hint->event_type == (uint32_t)-1 ||
+      !tt_init(&hint->cache, HINT_CACHE_BYTES))
+    return false;
+
+  pthread_mutex_init(&hint->lock, 0);
+  pthread_cond_init(&hint->requested_cond, 0);
+  if (pthread_create(&hint->thread, 0, hint_run, hint) != 0)
+    return false;
+  pthread_detach(hint->thread);
+  return true;
+}
+
+// The cached next move from `map`, or `HINT_NONE` or `HINT_GAVE_UP`. Returns
+// false if it is not known yet.
+static bool hint_find(HintEngine *hint, const Entity *map,
+                      uint32_t character_cell_i, char *move) {
+  SDL_assert(hint != 0);
+  SDL_assert(map != 0);
+  SDL_assert(move != 0);
+
+  pthread_mutex_lock(&hint->lock);
+  const uint32_t *const cached =
+      tt_find(&hint->cache, zobrist_hash(map, hint->size, character_cell_i));
+  if (cached)
+    *move = (char)*cached;
+  pthread_mutex_unlock(&hint->lock);
+  return cached != 0;
+}
+
+// Ask the worker to solve `map`, replacing any request it has not started.
+static void hint_request(HintEngine *hint, const Entity *map) {
+  SDL_assert(hint != 0);
+  SDL_assert(map != 0);
+
+  pthread_mutex_lock(&hint->lock);
+  __builtin_memcpy(hint->request, map, hint->size);
+  hint->requested = true;
+  pthread_cond_signal(&hint->requested_cond);
+  pthread_mutex_unlock(&hint->lock);
+}
+
+// Window title for the hint `move`.
+static void hint_title(char move, char *title, size_t title_len) {
+  static const char *const DIRECTION_NAMES[4] = {
+      [DIR_UP] = "up", [DIR_RIGHT] = "right", [DIR_DOWN] = "down",
+      [DIR_LEFT] = "left"};
+
+  if (move == HINT_NONE) {
+    snprintf(title, title_len, "Sokoban - No solution, press r to restart");
+    return;
+  }
+  if (move == HINT_GAVE_UP) {
+    snprintf(title, title_len, "Sokoban - No hint found");
+    return;
+  }
+  snprintf(title, title_len, "Sokoban - Hint: %s %s",
+           move >= 'A' && move <= 'Z' ? "push" : "walk",
+           DIRECTION_NAMES[direction_from_lurd(move)]);
+}
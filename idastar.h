@@ -0,0 +1,200 @@
+#pragma once
+
+// Iterative deepening A* over pushes: depth-first searches cut off at a bound
+// on pushes so far plus the matching lower bound of `heuristic.h`, each one
+// with the bound raised to the smallest value that went over the previous
+// one. Push-optimal.
+//
+// Memory is the depth-first stack plus the transposition table, whose size is
+// fixed: it does not grow with the search. The table remembers, for the
+// current iteration, the fewest pushes each state was reached with, so that
+// it is not expanded again with as many or more. A full table replaces
+// entries (see `tt_insert()`), which only costs repeated work.
+
+#include "heuristic.h"
+#include "search.h"
+
+typedef struct {
+  SolverNode node;
+  Matching matching;
+  SolverNode *children; // `SOLVER_MAX_SUCCESSORS` long, sorted on `h`.
+  uint32_t *children_h;
+  uint16_t children_len, next_child;
+} IdaFrame;
+
+typedef struct {
+  Solver *solver;
+  IdaFrame *frames;
+  uint32_t frames_cap;
+  uint32_t iteration;
+} IdaSearch;
+
+static IdaFrame *ida_frame(IdaSearch *ida, uint32_t depth) {
+  if (depth == ida->frames_cap) {
+    ida->frames_cap = ida->frames_cap ? ida->frames_cap * 2 : 64;
+    ida->frames = realloc(ida->frames, ida->frames_cap * sizeof(IdaFrame));
+    SDL_assert(ida->frames != 0);
+    for (uint32_t i = depth; i < ida->frames_cap; i++)
+      ida->frames[i] = (IdaFrame){0};
+  }
+
+  IdaFrame *const frame = &ida->frames[depth];
+  if (!frame->children) {
+    frame->children = malloc(SOLVER_MAX_SUCCESSORS * sizeof(SolverNode));
+    frame->children_h = malloc(SOLVER_MAX_SUCCESSORS * sizeof(uint32_t));
+    SDL_assert(frame->children != 0);
+    SDL_assert(frame->children_h != 0);
+  }
+  return frame;
+}
+
+// Whether the node of `frame` was already reached with as few pushes during
+// this iteration. Records it otherwise.
+static bool ida_seen(IdaSearch *ida, const IdaFrame *frame) {
+  TranspositionTable *const tt = &ida->solver->visited;
+  const uint32_t value = ida->iteration << 16 | frame->node.pushes;
+  uint32_t *const existing = tt_find(tt, frame->node.hash);
+  if (!existing) {
+    tt_insert(tt, frame->node.hash, value);
+    return false;
+  }
+  if (*existing >> 16 == ida->iteration &&
+      (*existing & 0xffff) <= frame->node.pushes)
+    return true;
+
+  *existing = value;
+  return false;
+}
+
+// Children of the node of `frame` that are not proven deadlocks, most
+// promising first.
+static void ida_expand(IdaSearch *ida, IdaFrame *frame) {
+  Solver *const solver = ida->solver;
+  const uint16_t children_len =
+      solver_successors(solver, &frame->node, frame->children);
+
+  frame->children_len = frame->next_child = 0;
+  for (uint16_t i = 0; i < children_len; i++) {
+    const SolverNode child = frame->children[i];
+    uint32_t h = 0;
+    if (solver->use_matching) {
+      Matching matching = frame->matching;
+      uint32_t from = 0, to = 0;
+      push_crate_move(&solver->layout, &frame->node, &child, &from, &to);
+      matching_move_crate(&matching, &solver->distances, from, to);
+      h = matching_cost(&matching, &solver->distances);
+      if (h == HEURISTIC_INFINITE)
+        continue;
+    }
+
+    // Insertion sort: few children.
+    uint16_t j = frame->children_len++;
+    for (; j > 0 && frame->children_h[j - 1] > h; j--) {
+      frame->children[j] = frame->children[j - 1];
+      frame->children_h[j] = frame->children_h[j - 1];
+    }
+    frame->children[j] = child;
+    frame->children_h[j] = h;
+  }
+}
+
+// One depth-first search from the root in `frames[0]`. Returns the depth of a
+// solved node, or 0 if none was found within `bound`. `next_bound` is lowered
+// to the smallest f that went over `bound`.
+static uint32_t ida_iteration(IdaSearch *ida, uint32_t bound,
+                              uint32_t *next_bound, SolverStats *stats) {
+  Solver *const solver = ida->solver;
+  uint32_t depth = 0;
+  IdaFrame *frame = ida_frame(ida, 0);
+  ida_seen(ida, frame);
+  ida_expand(ida, frame);
+  stats->nodes_expanded++;
+
+  while (true) {
+    frame = &ida->frames[depth];
+    if (frame->next_child == frame->children_len) {
+      if (depth == 0)
+        return 0;
+      depth--;
+      continue;
+    }
+
+    const uint16_t i = frame->next_child++;
+    const uint32_t f = frame->children[i].pushes + frame->children_h[i];
+    if (f > bound) {
+      // Children are sorted: the next ones go over too.
+      if (f < *next_bound)
+        *next_bound = f;
+      frame->next_child = frame->children_len;
+      continue;
+    }
+
+    if (solver_cancelled(solver))
+      return 0;
+
+    IdaFrame *const child = ida_frame(ida, depth + 1);
+    frame = &ida->frames[depth]; // `ida_frame()` may have moved it.
+    child->node = frame->children[i];
+    if (packed_is_won(&solver->layout, &child->node.state))
+      return depth + 1;
+    if (ida_seen(ida, child))
+      continue;
+
+    if (solver->use_matching) {
+      child->matching = frame->matching;
+      uint32_t from = 0, to = 0;
+      push_crate_move(&solver->layout, &frame->node, &child->node, &from, &to);
+      matching_move_crate(&child->matching, &solver->distances, from, to);
+    }
+    ida_expand(ida, child);
+    stats->nodes_expanded++;
+    depth++;
+  }
+}
+
+static void solve_idastar(Solver *solver, SolverNode *root,
+                          SolverStats *stats) {
+  push_root_init(&solver->layout, root);
+  if (packed_is_won(&solver->layout, &root->state)) {
+    stats->solution = calloc(1, 1);
+    return;
+  }
+
+  IdaSearch ida = {.solver = solver};
+  IdaFrame *const frame = ida_frame(&ida, 0);
+  frame->node = *root;
+  uint32_t bound = 0;
+  if (solver->use_matching) {
+    Entity map[MAP_MAX_SIZE];
+    unpack_state(&solver->layout, &root->state, map);
+    matching_init(&frame->matching, &solver->distances, map,
+                  solver->layout.size);
+    bound = matching_cost(&frame->matching, &solver->distances);
+  }
+
+  const double start = now_s();
+  while (bound < HEURISTIC_INFINITE && !solver_cancelled(solver)) {
+    ida.iteration++;
+    uint32_t next_bound = HEURISTIC_INFINITE;
+    const uint32_t depth = ida_iteration(&ida, bound, &next_bound, stats);
+    fprintf(stderr, "Bound %u: %llu nodes expanded, %.1f s\n", bound,
+            (unsigned long long)stats->nodes_expanded, now_s() - start);
+    if (depth) {
+      const SolverNode **path = malloc((depth + 1) * sizeof(SolverNode *));
+      SDL_assert(path != 0);
+      path[0] = &ida.frames[0].node;
+      for (uint32_t d = 1; d <= depth; d++)
+        path[d] = &ida.frames[d].node;
+      stats->solution = solution_from_pushes(&solver->layout, path, depth);
+      free(path);
+      break;
+    }
+    bound = next_bound;
+  }
+
+  for (uint32_t i = 0; i < ida.frames_cap; i++) {
+    free(ida.frames[i].children);
+    free(ida.frames[i].children_h);
+  }
+  free(ida.frames);
+}
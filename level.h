@@ -0,0 +1,181 @@
+#pragma once
+
+// A level in two layers: what never changes while playing (walls,
+// objectives, dead squares), set up once and shared by any number of games,
+// and the little that does, a `GameState`. Restarting or saving a position is
+// a copy of the state alone.
+//
+// Levels are any size, cells indexed row by row on 32 bits, and a step is an
+// offset from the `neighbours` table of the level.
+
+#include "deadlock.h"
+
+typedef struct {
+  uint64_t *crates; // `Level.words` long.
+  uint32_t character_cell_i;
+} GameState;
+
+typedef struct {
+  uint32_t width, height, size;
+  uint32_t words; // Of a bitmap of the cells.
+  int32_t neighbours[4];
+  Entity *statics; // Walls and objectives only.
+  uint64_t *walls;
+  uint64_t *objectives;
+  uint64_t *dead_squares;
+  uint32_t crates_count, objectives_count;
+  GameState start;
+} Level;
+
+static void game_state_init(const Level *level, GameState *state) {
+  SDL_assert(level != 0);
+  SDL_assert(state != 0);
+
+  state->crates = calloc(level->words, sizeof(uint64_t));
+  SDL_assert(state->crates != 0);
+  state->character_cell_i = 0;
+}
+
+static void game_state_copy(const Level *level, GameState *to,
+                            const GameState *from) {
+  SDL_assert(level != 0);
+  SDL_assert(to != 0);
+  SDL_assert(from != 0);
+
+  __builtin_memcpy(to->crates, from->crates, level->words * sizeof(uint64_t));
+  to->character_cell_i = from->character_cell_i;
+}
+
+static void game_state_destroy(GameState *state) {
+  SDL_assert(state != 0);
+
+  free(state->crates);
+  state->crates = 0;
+}
+
+// `map` is `width` by `height` cells.
+static void level_init(const Entity *map, uint32_t width, uint32_t height,
+                       Level *level) {
+  SDL_assert(map != 0);
+  SDL_assert(level != 0);
+
+  *level = (Level){.width = width, .height = height, .size = width * height};
+  level->words = BITMAP_WORDS(level->size);
+  map_neighbours(width, level->neighbours);
+  level->statics = malloc(level->size);
+  level->walls = calloc(level->words, sizeof(uint64_t));
+  level->objectives = calloc(level->words, sizeof(uint64_t));
+  level->dead_squares = calloc(level->words, sizeof(uint64_t));
+  SDL_assert(level->statics != 0);
+  SDL_assert(level->walls != 0);
+  SDL_assert(level->objectives != 0);
+  SDL_assert(level->dead_squares != 0);
+  game_state_init(level, &level->start);
+
+  count_map(map, level->size, &level->crates_count, &level->objectives_count,
+            &level->start.character_cell_i);
+  find_dead_squares(map, level->size, level->neighbours, level->dead_squares);
+  for (uint32_t i = 0; i < level->size; i++) {
+    level->statics[i] = map[i] & (ENTITY_WALL | ENTITY_OBJECTIVE);
+    if (bitset_contains(map[i], ENTITY_WALL))
+      bitmap_add(level->walls, i);
+    if (bitset_contains(map[i], ENTITY_OBJECTIVE))
+      bitmap_add(level->objectives, i);
+    if (bitset_contains(map[i], ENTITY_CRATE))
+      bitmap_add(level->start.crates, i);
+  }
+}
+
+static void level_destroy(Level *level) {
+  SDL_assert(level != 0);
+
+  free(level->statics);
+  free(level->walls);
+  free(level->objectives);
+  free(level->dead_squares);
+  game_state_destroy(&level->start);
+}
+
+// Both layers as one map of `Level.size` cells, for the renderer.
+static void level_compose(const Level *level, const GameState *state,
+                          Entity *map) {
+  SDL_assert(level != 0);
+  SDL_assert(state != 0);
+  SDL_assert(map != 0);
+
+  __builtin_memcpy(map, level->statics, level->size);
+  for (uint32_t w = 0; w < level->words; w++) {
+    for (uint64_t word = state->crates[w]; word; word &= word - 1)
+      bitset_add(&map[w * 64 + __builtin_ctzll(word)], ENTITY_CRATE);
+  }
+  bitset_add(&map[state->character_cell_i], ENTITY_CHARACTER);
+}
+
+// `go_by()` on the two layers.
+static GoResult game_go(const Level *level, GameState *state, Direction dir) {
+  SDL_assert(level != 0);
+  SDL_assert(state != 0);
+
+  const int32_t offset = level->neighbours[dir];
+  const uint32_t next_cell_i = state->character_cell_i + offset;
+  // MW => No pathing.
+  if (bitmap_contains(level->walls, next_cell_i))
+    return GO_BLOCKED;
+
+  // MN, MO => Free pathing.
+  if (!bitmap_contains(state->crates, next_cell_i)) {
+    state->character_cell_i = next_cell_i;
+    return GO_WALKED;
+  }
+
+  // MCW, MCC => No pathing.
+  const uint32_t next_next_cell_i = next_cell_i + offset;
+  if (bitmap_contains(level->walls, next_next_cell_i) ||
+      bitmap_contains(state->crates, next_next_cell_i))
+    return GO_BLOCKED;
+
+  // MCN, MCO => Advance the crate.
+  bitmap_remove(state->crates, next_cell_i);
+  bitmap_add(state->crates, next_next_cell_i);
+  state->character_cell_i = next_cell_i;
+  return GO_PUSHED;
+}
+
+// `go_back_by()` on the two layers.
+static void game_go_back(const Level *level, GameState *state, Direction dir,
+                         bool pushed) {
+  SDL_assert(level != 0);
+  SDL_assert(state != 0);
+
+  const int32_t offset = level->neighbours[dir];
+  const uint32_t cell_i = state->character_cell_i;
+  if (pushed) {
+    bitmap_remove(state->crates, cell_i + offset);
+    bitmap_add(state->crates, cell_i);
+  }
+  state->character_cell_i = cell_i - offset;
+}
+
+// Every objective holds a crate.
+static bool game_is_won(const Level *level, const GameState *state) {
+  uint64_t empty = 0;
+  for (uint32_t w = 0; w < level->words; w++)
+    empty |= level->objectives[w] & ~state->crates[w];
+  return empty == 0;
+}
+
+// Whether the crate just pushed onto `crate_i` makes the level unsolvable.
+static bool game_push_is_deadlock(const Level *level, const GameState *state,
+                                  uint32_t crate_i) {
+  Entity *map = malloc(level->size);
+  uint64_t *visited = calloc(level->words, sizeof(uint64_t));
+  SDL_assert(map != 0);
+  SDL_assert(visited != 0);
+  level_compose(level, state, map);
+  const bool deadlock = push_is_deadlock_by(map, level->neighbours,
+                                            level->dead_squares, visited,
+                                            crate_i);
+  free(map);
+  free(visited);
+  return deadlock;
+}
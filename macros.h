@@ -0,0 +1,240 @@
+#pragma once
+
+// Macro pushes for the push-level searches: several pushes of one crate made
+// as a single successor. Found once per level, at load time.
+//
+// - Tunnels: corridors one cell wide, walls on both sides. A crate pushed
+//   into a tunnel, with the character in the tunnel behind it, is pushed on
+//   until it leaves: stopping on the way would only block the corridor.
+//   Objectives end tunnels.
+// - Goal rooms: areas with objectives that can only be entered through one
+//   corridor cell, their door. A crate pushed in through the door can also
+//   go straight to an empty objective of the room: one more successor per
+//   objective it can reach. The plain push is kept, for the levels where a
+//   crate has to be parked in the room first.
+//
+// Tunnels cut the branching and goal rooms the depth, at a price: the
+// breadth-first searches count a macro as a single step, so they are no
+// longer push-optimal.
+
+#include "heap.h"
+#include "packed.h"
+
+#define MACROS_MAX_ROOMS 32
+// Cost of a push in `crate_paths()`, a step costs 1: fewest pushes first.
+#define CRATE_PATH_PUSH (1U << 16)
+#define CRATE_PATH_NONE UINT32_MAX
+
+typedef struct {
+  // Cells where a crate is in a tunnel, by the axis of the push: `DIR_UP`
+  // for vertical pushes, `DIR_RIGHT` for horizontal ones.
+  CellSet tunnels[2];
+  uint8_t room_of[MAP_MAX_SIZE]; // Goal room index + 1, 0 outside of any.
+  uint16_t doors[MACROS_MAX_ROOMS];
+  uint8_t rooms_len;
+} Macros;
+
+// Every way for the character to move one crate, the others staying put. By
+// packed bit of the crate cell (see `packed.h`), then character cell: a crate
+// that leaves the packed cells can never reach an objective anyway.
+typedef struct {
+  uint32_t *cost; // `CRATE_PATH_NONE` if unreachable.
+  uint32_t *previous;
+} CratePaths;
+
+static void crate_paths_init(const PackedLayout *layout, CratePaths *paths) {
+  SDL_assert(layout != 0);
+  SDL_assert(paths != 0);
+
+  const size_t len = (size_t)layout->bits_len * layout->size;
+  paths->cost = malloc(len * sizeof(uint32_t));
+  paths->previous = malloc(len * sizeof(uint32_t));
+  SDL_assert(paths->cost != 0);
+  SDL_assert(paths->previous != 0);
+}
+
+static void crate_paths_destroy(CratePaths *paths) {
+  SDL_assert(paths != 0);
+
+  free(paths->cost);
+  free(paths->previous);
+}
+
+// State of `paths` with the crate on `crate_i`, a packed cell, and the
+// character on `character_i`.
+static uint32_t crate_path_state(const PackedLayout *layout, uint32_t crate_i,
+                                 uint32_t character_i) {
+  SDL_assert(layout->bit_of_cell[crate_i] != PACKED_NO_BIT);
+  return layout->bit_of_cell[crate_i] * layout->size + character_i;
+}
+
+static uint8_t macros_axis(Direction dir) { return dir % 2; }
+
+static void compute_tunnels(const PackedLayout *layout, const Entity *map,
+                            Macros *macros) {
+  const int32_t *const neighbours = layout->neighbours;
+  for (uint32_t i = 0; i < layout->size; i++) {
+    if (bitset_contains(map[i], ENTITY_WALL) ||
+        bitset_contains(map[i], ENTITY_OBJECTIVE))
+      continue;
+
+    for (Direction axis = DIR_UP; axis <= DIR_RIGHT; axis++) {
+      // Walls across the axis.
+      const Direction side = axis + 1;
+      if (bitset_contains(map[i + neighbours[side]], ENTITY_WALL) &&
+          bitset_contains(map[i - neighbours[side]], ENTITY_WALL))
+        cellset_add(&macros->tunnels[axis], i);
+    }
+  }
+}
+
+// Floor on the `dir` side of `door`, with the door closed. Returns its size.
+static uint32_t goal_room_flood(const PackedLayout *layout, Entity *floor,
+                                uint32_t door, Direction dir, bool *room) {
+  floor[door] = ENTITY_WALL;
+  flood_fill(floor, layout->size, layout->neighbours,
+             door + layout->neighbours[dir], room);
+  floor[door] = ENTITY_NONE;
+
+  uint32_t size = 0;
+  for (uint32_t i = 0; i < layout->size; i++)
+    size += room[i];
+  return size;
+}
+
+// Doors are corridor cells whose removal splits the floor. A side holding
+// objectives but not the character is a room. Smaller rooms are taken first,
+// so that a door opens right onto its room.
+static void compute_goal_rooms(const PackedLayout *layout, const Entity *map,
+                               uint32_t character_cell_i, Macros *macros) {
+  const uint32_t size = layout->size;
+  const int32_t *const neighbours = layout->neighbours;
+  Entity floor[MAP_MAX_SIZE];
+  for (uint32_t i = 0; i < size; i++)
+    floor[i] = map[i] & (ENTITY_WALL | ENTITY_OBJECTIVE);
+
+  // Door cell, side and size of the room, sorted by size.
+  typedef struct {
+    uint16_t door;
+    Direction dir;
+    uint32_t size;
+  } Candidate;
+  Candidate *candidates = malloc(size * 4 * sizeof(Candidate));
+  SDL_assert(candidates != 0);
+  uint32_t candidates_len = 0;
+  for (uint32_t door = 0; door < size; door++) {
+    if (floor[door] != ENTITY_NONE ||
+        !(cellset_contains(&macros->tunnels[DIR_UP], door) ||
+          cellset_contains(&macros->tunnels[DIR_RIGHT], door)))
+      continue;
+
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      if (bitset_contains(floor[door + neighbours[dir]], ENTITY_WALL))
+        continue;
+
+      bool room[MAP_MAX_SIZE];
+      const uint32_t room_size =
+          goal_room_flood(layout, floor, door, dir, room);
+      bool has_objective = false;
+      for (uint32_t i = 0; i < size; i++)
+        has_objective |= room[i] && floor[i] == ENTITY_OBJECTIVE;
+      if (!has_objective || room[character_cell_i] ||
+          room[door - neighbours[dir]])
+        continue;
+
+      uint32_t c = candidates_len++;
+      for (; c > 0 && candidates[c - 1].size > room_size; c--)
+        candidates[c] = candidates[c - 1];
+      candidates[c].door = door;
+      candidates[c].dir = dir;
+      candidates[c].size = room_size;
+    }
+  }
+
+  for (uint32_t c = 0;
+       c < candidates_len && macros->rooms_len < MACROS_MAX_ROOMS; c++) {
+    bool room[MAP_MAX_SIZE];
+    goal_room_flood(layout, floor, candidates[c].door, candidates[c].dir,
+                    room);
+    bool taken = false;
+    for (uint32_t i = 0; i < size; i++)
+      taken |= room[i] && macros->room_of[i] != 0;
+    if (taken)
+      continue;
+
+    macros->doors[macros->rooms_len++] = candidates[c].door;
+    for (uint32_t i = 0; i < size; i++) {
+      if (room[i])
+        macros->room_of[i] = macros->rooms_len;
+    }
+  }
+  free(candidates);
+}
+
+static void compute_macros(const PackedLayout *layout, const Entity *map,
+                           uint32_t character_cell_i, Macros *macros) {
+  SDL_assert(layout != 0);
+  SDL_assert(map != 0);
+  SDL_assert(macros != 0);
+
+  *macros = (Macros){0};
+  compute_tunnels(layout, map, macros);
+  compute_goal_rooms(layout, map, character_cell_i, macros);
+}
+
+// Cheapest ways, fewest pushes first then fewest steps, for the character on
+// `character_i` to move the crate on `crate_i` (Dijkstra). `paths` is set up
+// by `crate_paths_init()`.
+static void crate_paths(const PackedLayout *layout, const Entity *map,
+                        uint32_t crate_i, uint32_t character_i,
+                        CratePaths *paths) {
+  SDL_assert(layout != 0);
+  SDL_assert(map != 0);
+  SDL_assert(paths != 0);
+
+  const uint32_t size = layout->size;
+  SDL_assert(crate_i < size);
+  Entity others[MAP_MAX_SIZE];
+  for (uint32_t i = 0; i < size; i++)
+    others[i] = map[i] & (ENTITY_WALL | ENTITY_CRATE);
+  bitset_remove(&others[crate_i], ENTITY_CRATE);
+
+  for (uint32_t s = 0; s < (uint32_t)layout->bits_len * size; s++)
+    paths->cost[s] = CRATE_PATH_NONE;
+  NodeHeap open = {0};
+  const uint32_t start = crate_path_state(layout, crate_i, character_i);
+  paths->cost[start] = 0;
+  node_heap_push(&open, start);
+  while (open.len > 0) {
+    const uint64_t key = node_heap_pop(&open);
+    const uint32_t state = (uint32_t)key;
+    const uint32_t cost = key >> 32;
+    if (cost != paths->cost[state])
+      continue;
+
+    const uint32_t crate = layout->cell_of_bit[state / size],
+                   character = state % size;
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const uint32_t next = character + layout->neighbours[dir];
+      if (others[next] != ENTITY_NONE)
+        continue;
+
+      uint32_t next_state = state - character + next, next_cost = cost + 1;
+      if (next == crate) {
+        const uint32_t next_crate = crate + layout->neighbours[dir];
+        if (others[next_crate] != ENTITY_NONE ||
+            layout->bit_of_cell[next_crate] == PACKED_NO_BIT)
+          continue;
+        next_state = crate_path_state(layout, next_crate, next);
+        next_cost = cost + CRATE_PATH_PUSH;
+      }
+      if (next_cost >= paths->cost[next_state])
+        continue;
+
+      paths->cost[next_state] = next_cost;
+      paths->previous[next_state] = state;
+      node_heap_push(&open, (uint64_t)next_cost << 32 | next_state);
+    }
+  }
+  free(open.items);
+}
@@ -1,6 +1,20 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <SDL.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#include "bench.h"
+#include "deadlock.h"
+#include "hint.h"
+#include "level.h"
+#include "optimize.h"
+#include "portfolio.h"
+#include "rules.h"
+#include "solver.h"
+#include "undo.h"
+#include "verify.h"
 
 // Sprites
 #include "character_down.h"
@@ -14,34 +28,12 @@
 
 #define pg_unused(x) ((void)(x))
 
-typedef enum { DIR_UP, DIR_RIGHT, DIR_DOWN, DIR_LEFT } Direction;
-typedef enum __attribute__((packed)) {
-  // Numbers do not matter, as long as `ENTITY_NONE` is 0.
-  ENTITY_NONE = 0,
-  ENTITY_WALL = 1 << 0,
-  ENTITY_OBJECTIVE = 1 << 1,
-  ENTITY_CRATE = 1 << 2,
-  ENTITY_CRATE_OK = (ENTITY_OBJECTIVE | ENTITY_CRATE), // Pseudo entity.
-  ENTITY_CHARACTER = 1 << 4,
-  ENTITY_MAX, // Not an entity.
-} Entity;
-
-static bool bitset_contains(Entity bitset, Entity b) {
-  return (bitset & b) == b;
-}
-static bool bitset_is_exactly(Entity bitset, Entity b) { return bitset == b; }
-static void bitset_remove(Entity *bitset, Entity b) { *bitset &= ~b; }
-static void bitset_add(Entity *bitset, Entity b) { *bitset |= b; }
-
-#define MAP_WIDTH 12
-#define MAP_HEIGHT 12
-#define MAP_SIZE ((MAP_WIDTH) * (MAP_WIDTH))
-
 static const uint32_t CELL_SIZE = 34;
-static const uint16_t SCREEN_WIDTH = MAP_WIDTH * CELL_SIZE;
-static const uint16_t SCREEN_HEIGHT = MAP_HEIGHT * CELL_SIZE;
 
-static const Entity map[MAP_WIDTH][MAP_HEIGHT] = {
+// The level played when none is given.
+#define DEFAULT_MAP_WIDTH 12
+#define DEFAULT_MAP_HEIGHT 12
+static const Entity map[DEFAULT_MAP_HEIGHT][DEFAULT_MAP_WIDTH] = {
     {ENTITY_WALL, ENTITY_WALL, ENTITY_WALL, ENTITY_WALL, ENTITY_WALL,
      ENTITY_WALL, ENTITY_WALL, ENTITY_WALL, ENTITY_WALL, ENTITY_WALL,
      ENTITY_WALL, ENTITY_WALL},
@@ -79,40 +71,6 @@ static const Entity map[MAP_WIDTH][MAP_HEIGHT] = {
      ENTITY_WALL, ENTITY_WALL, ENTITY_WALL, ENTITY_WALL, ENTITY_WALL,
      ENTITY_WALL, ENTITY_WALL}};
 
-static uint8_t get_next_cell_i(Direction dir, uint8_t cell_i) {
-  switch (dir) {
-  case DIR_UP:
-    return cell_i - MAP_WIDTH;
-  case DIR_RIGHT:
-    return cell_i + 1;
-  case DIR_DOWN:
-    return cell_i + MAP_WIDTH;
-  case DIR_LEFT:
-    return cell_i - 1;
-  }
-  __builtin_unreachable();
-}
-
-static void load_map(Entity *map, uint8_t *crates_count,
-                     uint8_t *objectives_count, uint8_t *character_cell_i) {
-  SDL_assert(map != 0);
-  SDL_assert(crates_count != 0);
-  SDL_assert(objectives_count != 0);
-  SDL_assert(character_cell_i != 0);
-
-  for (uint8_t i = 0; i < MAP_SIZE; i++) {
-    const Entity cell = map[i];
-    SDL_assert(cell == ENTITY_NONE || cell == ENTITY_CHARACTER ||
-               cell == ENTITY_WALL || cell == ENTITY_OBJECTIVE ||
-               cell == ENTITY_CRATE);
-
-    *crates_count += cell == ENTITY_CRATE;
-    *objectives_count += cell == ENTITY_OBJECTIVE;
-    if (cell == ENTITY_CHARACTER)
-      *character_cell_i = i;
-  }
-}
-
 static SDL_Texture *load_texture(SDL_Renderer *renderer, const uint8_t *data) {
   SDL_Surface *surface =
       SDL_CreateRGBSurfaceFrom((void *)data, CELL_SIZE, CELL_SIZE, 24,
@@ -125,60 +83,282 @@ static SDL_Texture *load_texture(SDL_Renderer *renderer, const uint8_t *data) {
   return texture;
 }
 
-static void go(Direction dir, uint8_t *character_cell_i, Entity *map) {
-  SDL_assert(character_cell_i != 0);
-  SDL_assert(map != 0);
+static const char TITLE[] = "Sokoban";
+static const char TITLE_DEAD_END[] = "Sokoban - Dead end, press r to restart";
+static const char TITLE_THINKING[] = "Sokoban - Thinking...";
 
-  uint8_t next_cell_i = get_next_cell_i(dir, *character_cell_i);
-  Entity *const next_cell = &map[next_cell_i];
-  // MW => No pathing.
-  if (bitset_is_exactly(*next_cell, ENTITY_WALL))
-    return;
+// Returns true if the step pushed a crate into a deadlock.
+static bool step(Direction dir, const Level *level, GameState *state,
+                 MoveLog *log) {
+  if (move_log_go(log, level, state, dir) != GO_PUSHED)
+    return false;
 
-  // MN, MO => Free pathing.
-  if (bitset_is_exactly(*next_cell, ENTITY_NONE) ||
-      bitset_is_exactly(*next_cell, ENTITY_OBJECTIVE)) {
-    bitset_remove(&map[*character_cell_i], ENTITY_CHARACTER);
-    bitset_add(next_cell, ENTITY_CHARACTER);
+  return game_push_is_deadlock(
+      level, state, state->character_cell_i + level->neighbours[dir]);
+}
 
-    *character_cell_i = next_cell_i;
-    return;
+static void solve_usage(void) {
+  fprintf(stderr, "Usage: sokoban --solve "
+                  "[--search moves|pushes|astar|greedy|idastar|bidir|external] "
+                  "[--portfolio] [--threads N] [--ram MiB] [--tmp DIR] "
+                  "[--macros] map.soko\n");
+}
+
+// `args` are the command line arguments following `--solve`.
+static int solve_main(int args_len, char *args[]) {
+  const char *tmp_dir = getenv("TMPDIR");
+  SolverOptions options = {
+      .mode = SEARCH_PUSHES,
+      .threads = 1,
+      .ram_bytes = SOLVER_TT_BYTES,
+      .tmp_dir = tmp_dir ? tmp_dir : "/tmp",
+  };
+  const char *path = 0;
+  bool portfolio = false, search = false;
+  for (int i = 0; i < args_len; i++) {
+    if (strcmp(args[i], "--search") == 0 && i + 1 < args_len) {
+      const char *mode = args[++i];
+      search = true;
+      options.mode = SEARCH_MOVES;
+      while (options.mode <= SEARCH_EXTERNAL &&
+             strcmp(mode, SEARCH_NAMES[options.mode]) != 0)
+        options.mode++;
+      if (options.mode > SEARCH_EXTERNAL) {
+        solve_usage();
+        return 1;
+      }
+    } else if (strcmp(args[i], "--threads") == 0 && i + 1 < args_len) {
+      const long threads = strtol(args[++i], 0, 10);
+      if (threads < 1 || threads > PARALLEL_MAX_THREADS) {
+        fprintf(stderr, "--threads must be between 1 and %d\n",
+                PARALLEL_MAX_THREADS);
+        return 1;
+      }
+      options.threads = (uint32_t)threads;
+    } else if (strcmp(args[i], "--ram") == 0 && i + 1 < args_len) {
+      const long mib = strtol(args[++i], 0, 10);
+      if (mib < 1) {
+        fprintf(stderr, "--ram must be at least 1 MiB\n");
+        return 1;
+      }
+      options.ram_bytes = (size_t)mib << 20;
+    } else if (strcmp(args[i], "--tmp") == 0 && i + 1 < args_len) {
+      options.tmp_dir = args[++i];
+    } else if (strcmp(args[i], "--macros") == 0) {
+      options.macros = true;
+    } else if (strcmp(args[i], "--portfolio") == 0) {
+      portfolio = true;
+    } else if (!path && args[i][0] != '-') {
+      path = args[i];
+    } else {
+      solve_usage();
+      return 1;
+    }
+  }
+  if (!path) {
+    solve_usage();
+    return 1;
+  }
+  if (portfolio && (search || options.threads > 1)) {
+    fprintf(stderr, "--portfolio picks its searches, on one thread each: "
+                    "no --search or --threads\n");
+    return 1;
+  }
+  if (options.threads > 1 && options.mode != SEARCH_PUSHES) {
+    fprintf(stderr, "--threads only works with --search pushes\n");
+    return 1;
   }
 
-  // MC* from this point on.
+  Entity *cells = 0;
+  uint32_t width = 0, height = 0;
+  if (!read_level(path, &cells, &width, &height))
+    return 1;
+
+  SolverStats stats = {0};
+  if (portfolio)
+    solve_portfolio(cells, width, height, &options, &stats);
+  else
+    solve(cells, width, height, &options, &stats);
+  free(cells);
+  print_solver_stats(&stats);
+  if (!stats.solution)
+    return 1;
+
+  printf("%s\n", stats.solution);
+  free(stats.solution);
+  return 0;
+}
+
+// The first line of `file`, without its line ending. Heap allocated.
+static char *read_line(FILE *file) {
+  size_t len = 0, cap = 256;
+  char *line = malloc(cap);
+  SDL_assert(line != 0);
+  int c;
+  while ((c = fgetc(file)) != EOF && c != '\n') {
+    if (c == '\r')
+      continue;
+    if (len + 1 == cap) {
+      cap *= 2;
+      line = realloc(line, cap);
+      SDL_assert(line != 0);
+    }
+    line[len++] = (char)c;
+  }
+  line[len] = 0;
+  return line;
+}
 
-  Entity *const next_next_cell = &map[get_next_cell_i(dir, next_cell_i)];
+// `args` are the command line arguments following `--optimize`.
+static int optimize_main(int args_len, char *args[]) {
+  if (args_len < 1 || args_len > 2) {
+    fprintf(stderr, "Usage: sokoban --optimize map.soko [solution.txt]\n");
+    return 1;
+  }
 
-  // MCW, MCC => No pathing.
-  if (bitset_is_exactly(*next_next_cell, ENTITY_WALL) ||
-      bitset_contains(*next_next_cell, ENTITY_CRATE))
-    return;
+  Entity *cells = 0;
+  uint32_t width = 0, height = 0;
+  if (!read_level(args[0], &cells, &width, &height))
+    return 1;
+  FILE *const file = args_len == 2 ? fopen(args[1], "r") : stdin;
+  if (!file) {
+    fprintf(stderr, "Failed to open %s\n", args[1]);
+    free(cells);
+    return 1;
+  }
+  char *const solution = read_line(file);
+  if (file != stdin)
+    fclose(file);
+
+  char *fewer_moves = 0, *fewer_pushes = 0;
+  const bool ok = optimize_solution(cells, width, height, solution,
+                                    &fewer_moves, &fewer_pushes);
+  free(solution);
+  free(cells);
+  if (!ok)
+    return 1;
+
+  SolverStats moves = {0}, pushes = {0};
+  solver_count_moves(fewer_moves, &moves);
+  solver_count_moves(fewer_pushes, &pushes);
+  fprintf(stderr, "Fewer moves: %u moves, %u pushes\n", moves.moves,
+          moves.pushes);
+  fprintf(stderr, "Fewer pushes: %u moves, %u pushes\n", pushes.moves,
+          pushes.pushes);
+  printf("%s\n%s\n", fewer_moves, fewer_pushes);
+  free(fewer_moves);
+  free(fewer_pushes);
+  return 0;
+}
 
-  // MCN, MCO => Advance the crate.
-  if (bitset_is_exactly(*next_next_cell, ENTITY_NONE) ||
-      bitset_contains(*next_next_cell, ENTITY_OBJECTIVE)) {
-    bitset_remove(&map[*character_cell_i], ENTITY_CHARACTER);
-    bitset_remove(next_cell, ENTITY_CRATE);
-    bitset_add(next_cell, ENTITY_CHARACTER);
-    bitset_add(next_next_cell, ENTITY_CRATE);
+// `args` are the command line arguments following `--bench moves`. Without a
+// solution, the level is solved first.
+static int bench_moves_main(int args_len, char *args[]) {
+  Entity *cells = malloc(sizeof(map));
+  SDL_assert(cells != 0);
+  uint32_t width = DEFAULT_MAP_WIDTH, height = DEFAULT_MAP_HEIGHT;
+  __builtin_memcpy(cells, map, sizeof(map));
+  if (args_len >= 1) {
+    free(cells);
+    if (!read_level(args[0], &cells, &width, &height))
+      return 1;
+  }
 
-    *character_cell_i = next_cell_i;
+  char *solution = 0;
+  if (args_len == 2) {
+    FILE *file = fopen(args[1], "r");
+    if (!file) {
+      fprintf(stderr, "Failed to open %s\n", args[1]);
+      free(cells);
+      return 1;
+    }
+    solution = read_line(file);
+    fclose(file);
+  } else {
+    const SolverOptions options = {
+        .mode = SEARCH_ASTAR, .threads = 1, .ram_bytes = SOLVER_TT_BYTES};
+    SolverStats stats;
+    solve(cells, width, height, &options, &stats);
+    solution = stats.solution;
   }
+
+  const bool ok = solution && bench_moves(cells, width, height, solution);
+  free(solution);
+  free(cells);
+  return ok ? 0 : 1;
 }
 
-int main(int argc, char *argv[]) {
-  pg_unused(argc);
-  pg_unused(argv);
+// `args` are the command line arguments following `--bench`.
+static int bench_main(int args_len, char *args[]) {
+  if (args_len == 1 && strcmp(args[0], "visited") == 0)
+    return bench_visited() ? 0 : 1;
+  if (args_len >= 1 && args_len <= 2 && strcmp(args[0], "flood") == 0) {
+    Entity *cells = 0;
+    uint32_t width = DEFAULT_MAP_WIDTH, height = DEFAULT_MAP_HEIGHT;
+    if (args_len == 2 && !read_level(args[1], &cells, &width, &height))
+      return 1;
+    const bool ok = bench_flood(cells ? cells : &map[0][0], width, height);
+    free(cells);
+    return ok ? 0 : 1;
+  }
 
+  if (args_len >= 1 && args_len <= 3 && strcmp(args[0], "moves") == 0)
+    return bench_moves_main(args_len - 1, args + 1);
+
+  if (args_len >= 1 && args_len <= 2 && strcmp(args[0], "batch") == 0) {
+    Entity *cells = 0;
+    uint32_t width = DEFAULT_MAP_WIDTH, height = DEFAULT_MAP_HEIGHT;
+    if (args_len == 2 && !read_level(args[1], &cells, &width, &height))
+      return 1;
+    const bool ok = bench_batch(cells ? cells : &map[0][0], width, height);
+    free(cells);
+    return ok ? 0 : 1;
+  }
 
-  uint8_t crates_count = 0, objectives_count = 0, character_cell_i = 0;
-  Entity game_map[MAP_SIZE] = {0};
-  __builtin_memcpy(game_map, map, MAP_SIZE);
-  load_map(game_map, &crates_count, &objectives_count, &character_cell_i);
+  fprintf(stderr, "Usage: sokoban --bench visited|flood|batch [map.soko]\n"
+                  "       sokoban --bench moves [map.soko [solution.txt]]\n");
+  return 1;
+}
 
-  SDL_Window *window =
-      SDL_CreateWindow("Sokoban", SDL_WINDOWPOS_UNDEFINED,
-                       SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+int main(int argc, char *argv[]) {
+  zobrist_init();
+
+  if (argc >= 2 && strcmp(argv[1], "--solve") == 0)
+    return solve_main(argc - 2, argv + 2);
+  if (argc >= 2 && strcmp(argv[1], "--optimize") == 0)
+    return optimize_main(argc - 2, argv + 2);
+  if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    return bench_main(argc - 2, argv + 2);
+  if (argc >= 2 && strcmp(argv[1], "--verify") == 0) {
+    if (argc != 4) {
+      fprintf(stderr, "Usage: sokoban --verify solutions.txt levels.sok\n");
+      return 1;
+    }
+    return verify(argv[2], argv[3]) ? 0 : 1;
+  }
+
+  Level level;
+  if (argc == 2) {
+    Entity *cells = 0;
+    uint32_t width = 0, height = 0;
+    if (!read_level(argv[1], &cells, &width, &height))
+      return 1;
+    level_init(cells, width, height, &level);
+    free(cells);
+  } else {
+    level_init(&map[0][0], DEFAULT_MAP_WIDTH, DEFAULT_MAP_HEIGHT, &level);
+  }
+  GameState state;
+  game_state_init(&level, &state);
+  game_state_copy(&level, &state, &level.start);
+  MoveLog log = {0};
+  // Both layers, when they are needed together.
+  Entity *game_map = malloc(level.size);
+  SDL_assert(game_map != 0);
+
+  SDL_Window *window = SDL_CreateWindow(
+      TITLE, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+      level.width * CELL_SIZE, level.height * CELL_SIZE, 0);
   if (!window)
     exit(1);
 
@@ -200,59 +380,108 @@ int main(int argc, char *argv[]) {
       [ENTITY_WALL] = load_texture(renderer, wall_rgb),
   };
 
+  // Hints are best effort: the game works without them, and without levels
+  // the solver does not take.
+  HintEngine hint;
+  level_compose(&level, &level.start, game_map);
+  const bool hints = hint_init(&hint, game_map, level.width, level.height);
+  bool hint_wanted = false; // Until the next move.
+  char hint_title_buf[64];
+
   while (true) {
     SDL_Event e;
     SDL_WaitEvent(&e);
     if (e.type == SDL_QUIT) {
       exit(0);
     } else if (e.type == SDL_KEYDOWN) {
+      if (hint_wanted && e.key.keysym.sym != SDLK_h) {
+        hint_wanted = false;
+        SDL_SetWindowTitle(window, TITLE);
+      }
+
       switch (e.key.keysym.sym) {
       case SDLK_ESCAPE:
         exit(0);
         break;
 
       case SDLK_r:
-        __builtin_memcpy(game_map, map, MAP_SIZE);
-        load_map(game_map, &crates_count, &objectives_count, &character_cell_i);
+        // Every move undone at once: they can still be redone.
+        game_state_copy(&level, &state, &level.start);
+        log.len = 0;
+        SDL_SetWindowTitle(window, TITLE);
+        break;
+
+      case SDLK_u:
+        if (move_log_undo(&log, &level, &state))
+          SDL_SetWindowTitle(window, TITLE);
+        break;
+
+      case SDLK_y:
+        if (move_log_redo(&log, &level, &state))
+          SDL_SetWindowTitle(window, TITLE);
+        break;
+
+      case SDLK_h:
+        if (!hints || hint_wanted)
+          break;
+        hint_wanted = true;
+        char move;
+        level_compose(&level, &state, game_map);
+        if (!hint_find(&hint, game_map, state.character_cell_i, &move)) {
+          hint_request(&hint, game_map);
+          SDL_SetWindowTitle(window, TITLE_THINKING);
+          break;
+        }
+        hint_title(move, hint_title_buf, sizeof(hint_title_buf));
+        SDL_SetWindowTitle(window, hint_title_buf);
         break;
 
       case SDLK_UP:
         current = character[DIR_UP];
-        go(DIR_UP, &character_cell_i, game_map);
+        if (step(DIR_UP, &level, &state, &log))
+          SDL_SetWindowTitle(window, TITLE_DEAD_END);
         break;
 
       case SDLK_RIGHT:
         current = character[DIR_RIGHT];
-        go(DIR_RIGHT, &character_cell_i, game_map);
+        if (step(DIR_RIGHT, &level, &state, &log))
+          SDL_SetWindowTitle(window, TITLE_DEAD_END);
         break;
 
       case SDLK_DOWN:
         current = character[DIR_DOWN];
-        go(DIR_DOWN, &character_cell_i, game_map);
+        if (step(DIR_DOWN, &level, &state, &log))
+          SDL_SetWindowTitle(window, TITLE_DEAD_END);
         break;
 
       case SDLK_LEFT:
         current = character[DIR_LEFT];
-        go(DIR_LEFT, &character_cell_i, game_map);
+        if (step(DIR_LEFT, &level, &state, &log))
+          SDL_SetWindowTitle(window, TITLE_DEAD_END);
         break;
       }
+    } else if (hints && e.type == hint.event_type && hint_wanted) {
+      // Solved from some position, maybe this one.
+      char move;
+      level_compose(&level, &state, game_map);
+      if (hint_find(&hint, game_map, state.character_cell_i, &move)) {
+        hint_title(move, hint_title_buf, sizeof(hint_title_buf));
+        SDL_SetWindowTitle(window, hint_title_buf);
+      }
     }
     SDL_RenderClear(renderer);
+    level_compose(&level, &state, game_map);
 
-    uint8_t crates_ok_count = 0;
-    for (uint8_t i = 0; i < MAP_WIDTH * MAP_HEIGHT; i++) {
+    for (uint32_t i = 0; i < level.size; i++) {
       const Entity cell = game_map[i];
 
       if (bitset_is_exactly(cell, ENTITY_NONE)) // Nothing to render.
         continue;
 
-      // Since we are iterating on each cell, count the number of crates ok.
-      crates_ok_count += bitset_is_exactly(cell, ENTITY_CRATE_OK);
-
       const SDL_Rect rect = {.w = CELL_SIZE,
                              .h = CELL_SIZE,
-                             .x = CELL_SIZE * (i % MAP_HEIGHT),
-                             .y = CELL_SIZE * (i / MAP_WIDTH)};
+                             .x = CELL_SIZE * (i % level.width),
+                             .y = CELL_SIZE * (i / level.width)};
 
       // Get the right texture. Maybe it could be made branchless with bit
       // operations, e.g. get the highest bit.
@@ -274,7 +503,7 @@ int main(int argc, char *argv[]) {
     SDL_RenderPresent(renderer);
 
     // The end?
-    if (crates_ok_count == objectives_count) {
+    if (game_is_won(&level, &state)) {
       SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_INFORMATION, "You won!", "Yeah!",
                                window);
       exit(0);
@@ -0,0 +1,101 @@
+#pragma once
+
+// Observations of games for training agents, written straight into a buffer
+// of the caller, laid out as it says (`ObserveStrides`), so that nothing is
+// allocated or copied again per step.
+//
+// An observation is either the `Entity` bits of every cell, or four planes of
+// 0 or 1 per cell: walls, objectives, crates and the character. With AVX2,
+// planes are expanded 32 cells at a time where the cells of the buffer are
+// next to each other.
+
+#include "batch.h"
+#include "level.h"
+
+typedef enum {
+  OBSERVE_GRID,
+  OBSERVE_PLANES,
+} ObserveFormat;
+
+#define OBSERVE_PLANES_LEN 4
+static const Entity OBSERVE_PLANE_ENTITIES[OBSERVE_PLANES_LEN] = {
+    ENTITY_WALL, ENTITY_OBJECTIVE, ENTITY_CRATE, ENTITY_CHARACTER};
+
+// In bytes, between two of each in the buffer.
+typedef struct {
+  size_t game, plane, row, cell;
+} ObserveStrides;
+
+// The `len` cells of `cells`, in order at `out`.
+static void observe_run(const Entity *cells, uint32_t len,
+                        ObserveFormat format, uint8_t *out,
+                        const ObserveStrides *strides) {
+  if (format == OBSERVE_GRID) {
+    __builtin_memcpy(out, cells, len);
+    return;
+  }
+
+  for (uint8_t p = 0; p < OBSERVE_PLANES_LEN; p++) {
+    const Entity entity = OBSERVE_PLANE_ENTITIES[p];
+    uint8_t *const plane = out + p * strides->plane;
+    uint32_t i = 0;
+#ifdef __AVX2__
+    const __m256i bit = _mm256_set1_epi8(entity);
+    for (; i + 32 <= len; i += 32) {
+      const __m256i chunk = _mm256_loadu_si256((const __m256i *)&cells[i]);
+      const __m256i set = _mm256_and_si256(
+          _mm256_cmpeq_epi8(_mm256_and_si256(chunk, bit), bit),
+          _mm256_set1_epi8(1));
+      _mm256_storeu_si256((__m256i *)&plane[i], set);
+    }
+#endif
+    for (; i < len; i++)
+      plane[i] = bitset_contains(cells[i], entity);
+  }
+}
+
+// The observation of the `Level.size` cells of a game of `level`, at `out`.
+static void observe_cells(const Level *level, const Entity *cells,
+                          ObserveFormat format, uint8_t *out,
+                          const ObserveStrides *strides) {
+  SDL_assert(level != 0);
+  SDL_assert(cells != 0);
+  SDL_assert(out != 0);
+  SDL_assert(strides != 0);
+
+  // Rows one after the other: one run.
+  if (strides->cell == 1 && strides->row == level->width) {
+    observe_run(cells, level->size, format, out, strides);
+    return;
+  }
+  if (strides->cell == 1) {
+    for (uint32_t y = 0; y < level->height; y++)
+      observe_run(&cells[y * level->width], level->width, format,
+                  out + y * strides->row, strides);
+    return;
+  }
+
+  for (uint32_t i = 0; i < level->size; i++) {
+    uint8_t *const cell_out = out + i / level->width * strides->row +
+                              i % level->width * strides->cell;
+    if (format == OBSERVE_GRID) {
+      *cell_out = cells[i];
+      continue;
+    }
+    for (uint8_t p = 0; p < OBSERVE_PLANES_LEN; p++)
+      cell_out[p * strides->plane] =
+          bitset_contains(cells[i], OBSERVE_PLANE_ENTITIES[p]);
+  }
+}
+
+// Every game of `batch`, game `g` at `out + g * strides->game`.
+static void observe_batch(Batch *batch, ObserveFormat format, uint8_t *out,
+                          const ObserveStrides *strides) {
+  SDL_assert(batch != 0);
+  SDL_assert(out != 0);
+  SDL_assert(strides != 0);
+
+  for (uint32_t g = 0; g < batch->count; g++)
+    observe_cells(batch->level, batch_compose(batch, g), format,
+                  out + g * strides->game, strides);
+}
@@ -0,0 +1,320 @@
+#pragma once
+
+// Shortening of an existing solution, run with `sokoban --optimize`.
+//
+// The solution is replayed and cut at its pushes, each one a push-level
+// state. Windows of up to `OPTIMIZE_WINDOW` pushes are then searched again,
+// cheapest first, for a cheaper way between their two ends, which replaces
+// the window: detours and pushes undone later disappear. Finally the walks
+// between pushes are rebuilt as shortest paths.
+//
+// Two variants come out: fewest moves first, and fewest pushes first. Neither
+// is optimal, only no worse than the input on its own metric.
+
+#include "search.h"
+
+#define OPTIMIZE_WINDOW 4
+// Nodes per window search before giving up on that window.
+#define OPTIMIZE_MAX_NODES (1U << 13)
+
+typedef enum { OPTIMIZE_MOVES, OPTIMIZE_PUSHES } OptimizeMetric;
+
+typedef struct {
+  Solver solver; // Nodes of the current window search.
+  uint32_t *moves; // By node, since the start of the window.
+  SolverNode *children;
+  // The state after each push of the solution, the initial one first.
+  SolverNode *states;
+  uint32_t states_len, states_cap;
+} Optimizer;
+
+// Both counts in one integer, the one to minimize first in the high bits.
+static uint32_t optimize_cost(OptimizeMetric metric, uint32_t moves,
+                              uint32_t pushes) {
+  SDL_assert(moves < (1U << 20) && pushes < (1U << 10));
+  return metric == OPTIMIZE_PUSHES ? pushes << 20 | moves
+                                   : moves << 10 | pushes;
+}
+
+// Push-level hashes only know the region of the character: the window ends
+// need its exact cell.
+static uint64_t optimize_hash(const SolverNode *node) {
+  return node->hash ^ zobrist_keys.character[node->state.region_i] ^
+         zobrist_keys.character[node->state.character_cell_i];
+}
+
+static bool optimize_same_state(const SolverNode *a, const SolverNode *b) {
+  return a->state.character_cell_i == b->state.character_cell_i &&
+         __builtin_memcmp(a->state.crates, b->state.crates,
+                          sizeof(a->state.crates)) == 0;
+}
+
+// Moves from `parent` to its child `node`: the walk behind the crate, then
+// the push.
+static uint32_t optimize_step_moves(const PackedLayout *layout,
+                                    const SolverNode *parent,
+                                    const SolverNode *node) {
+  Entity map[MAP_MAX_SIZE];
+  unpack_state(layout, &parent->state, map);
+  const uint32_t origin_i =
+      node->state.character_cell_i -
+      layout->neighbours[direction_from_lurd(node->move)];
+  char walk[MAP_MAX_SIZE];
+  const int32_t walk_len =
+      walk_path(layout, map, parent->state.character_cell_i, origin_i, walk);
+  SDL_assert(walk_len >= 0);
+  return walk_len + 1;
+}
+
+// Steps from `from` to every cell of `map`, `UINT16_MAX` if unreachable.
+static void optimize_walk_distances(const PackedLayout *layout,
+                                    const Entity *map, uint32_t from,
+                                    uint16_t *distances) {
+  for (uint32_t i = 0; i < layout->size; i++)
+    distances[i] = UINT16_MAX;
+  uint16_t queue[MAP_MAX_SIZE];
+  uint32_t queue_head = 0, queue_len = 0;
+
+  distances[from] = 0;
+  queue[queue_len++] = from;
+  while (queue_head < queue_len) {
+    const uint32_t cell_i = queue[queue_head++];
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const uint32_t next_cell_i = cell_i + layout->neighbours[dir];
+      if (distances[next_cell_i] != UINT16_MAX ||
+          bitset_contains(map[next_cell_i], ENTITY_WALL) ||
+          bitset_contains(map[next_cell_i], ENTITY_CRATE))
+        continue;
+
+      distances[next_cell_i] = distances[cell_i] + 1;
+      queue[queue_len++] = next_cell_i;
+    }
+  }
+}
+
+static void optimize_reserve(Optimizer *opt, uint32_t states_len) {
+  if (states_len <= opt->states_cap)
+    return;
+
+  while (opt->states_cap < states_len)
+    opt->states_cap = opt->states_cap ? opt->states_cap * 2 : 64;
+  opt->states = realloc(opt->states, opt->states_cap * sizeof(SolverNode));
+  SDL_assert(opt->states != 0);
+}
+
+// Replay `solution` on `map`, `width` by `height` cells, and keep the state
+// after each push. Returns false if it is not a solution.
+static bool optimize_init(Optimizer *opt, const Entity *map, uint32_t width,
+                          uint32_t height, const char *solution) {
+  *opt = (Optimizer){0};
+  SolverNode root;
+  if (!solver_init(&opt->solver, map, width, height,
+                   4 * OPTIMIZE_MAX_NODES * sizeof(TTEntry), false, &root))
+    return false;
+  opt->moves = malloc(OPTIMIZE_MAX_NODES * sizeof(uint32_t));
+  opt->children = malloc(SOLVER_MAX_SUCCESSORS * sizeof(SolverNode));
+  SDL_assert(opt->moves != 0);
+  SDL_assert(opt->children != 0);
+
+  const PackedLayout *const layout = &opt->solver.layout;
+  push_root_init(layout, &root);
+  optimize_reserve(opt, 1);
+  opt->states[opt->states_len++] = root;
+
+  Entity replay[MAP_MAX_SIZE];
+  unpack_state(layout, &root.state, replay);
+  uint32_t character_cell_i = root.state.character_cell_i;
+  for (const char *move = solution; *move; move++) {
+    if (!strchr("lurdLURD", *move)) {
+      fprintf(stderr, "Invalid move `%c` in the solution\n", *move);
+      return false;
+    }
+    const Direction dir = direction_from_lurd(*move);
+    const GoResult res =
+        go_by(layout->neighbours[dir], &character_cell_i, replay);
+    if (res == GO_BLOCKED) {
+      fprintf(stderr, "Move %zu of the solution is blocked\n",
+              (size_t)(move - solution) + 1);
+      return false;
+    }
+    if (res != GO_PUSHED)
+      continue;
+
+    SolverNode node = {.parent = SOLVER_NO_PARENT, .move = LURD_PUSH[dir]};
+    pack_state(layout, replay, character_cell_i, &node.state);
+    push_root_init(layout, &node);
+    optimize_reserve(opt, opt->states_len + 1);
+    opt->states[opt->states_len++] = node;
+  }
+  if (!packed_is_won(layout, &opt->states[opt->states_len - 1].state)) {
+    fprintf(stderr, "The solution does not solve the level\n");
+    return false;
+  }
+  return true;
+}
+
+static void optimize_destroy(Optimizer *opt) {
+  solver_destroy(&opt->solver);
+  free(opt->moves);
+  free(opt->children);
+  free(opt->states);
+}
+
+// Search for a way from `states[first]` to `states[last]` cheaper than the
+// current one. If there is one, it replaces the states in between and true
+// is returned.
+static bool optimize_window(Optimizer *opt, OptimizeMetric metric,
+                            uint32_t first, uint32_t last) {
+  Solver *const solver = &opt->solver;
+  const PackedLayout *const layout = &solver->layout;
+  uint32_t moves = 0;
+  for (uint32_t i = first + 1; i <= last; i++)
+    moves += optimize_step_moves(layout, &opt->states[i - 1], &opt->states[i]);
+  const uint32_t bound = optimize_cost(metric, moves, last - first);
+  const SolverNode *const target = &opt->states[last];
+
+  solver->nodes_len = 0;
+  tt_clear(&solver->visited);
+  SolverNode start = opt->states[first];
+  start.parent = SOLVER_NO_PARENT;
+  start.pushes = 0;
+  solver_append(solver, &start);
+  tt_insert(&solver->visited, optimize_hash(&start), 0);
+  opt->moves[0] = 0;
+
+  NodeHeap open = {0};
+  node_heap_push(&open, 0);
+  uint32_t found_i = SOLVER_NO_PARENT;
+  while (open.len > 0) {
+    const uint64_t key = node_heap_pop(&open);
+    const uint32_t node_i = (uint32_t)key;
+    // A copy: appending children may move the nodes.
+    const SolverNode parent = solver->nodes[node_i];
+    if (key >> 32 != optimize_cost(metric, opt->moves[node_i], parent.pushes))
+      continue; // Reached again for cheaper since.
+    if (optimize_same_state(&parent, target)) {
+      found_i = node_i;
+      break;
+    }
+    if (solver->nodes_len + SOLVER_MAX_SUCCESSORS > OPTIMIZE_MAX_NODES)
+      break;
+
+    Entity map[MAP_MAX_SIZE];
+    unpack_state(layout, &parent.state, map);
+    uint16_t distances[MAP_MAX_SIZE];
+    optimize_walk_distances(layout, map, parent.state.character_cell_i,
+                            distances);
+    const uint16_t children_len =
+        solver_successors(solver, &parent, opt->children);
+    for (uint16_t c = 0; c < children_len; c++) {
+      SolverNode *const child = &opt->children[c];
+      child->parent = node_i;
+      // The walk behind the crate, then the push.
+      const uint32_t origin_i =
+          child->state.character_cell_i -
+          layout->neighbours[direction_from_lurd(child->move)];
+      const uint32_t child_moves =
+          opt->moves[node_i] + distances[origin_i] + 1;
+      const uint32_t cost = optimize_cost(metric, child_moves, child->pushes);
+      if (cost >= bound)
+        continue;
+
+      uint32_t child_i;
+      uint32_t *const existing =
+          tt_find(&solver->visited, optimize_hash(child));
+      if (existing && optimize_same_state(&solver->nodes[*existing], child)) {
+        child_i = *existing;
+        if (optimize_cost(metric, opt->moves[child_i],
+                          solver->nodes[child_i].pushes) <= cost)
+          continue;
+        solver->nodes[child_i] = *child;
+      } else {
+        child_i = solver_append(solver, child);
+        tt_insert(&solver->visited, optimize_hash(child), child_i);
+      }
+      opt->moves[child_i] = child_moves;
+      node_heap_push(&open, (uint64_t)cost << 32 | child_i);
+    }
+  }
+  free(open.items);
+  if (found_i == SOLVER_NO_PARENT)
+    return false;
+
+  // Splice the path in place of the window.
+  const uint32_t pushes = solver->nodes[found_i].pushes;
+  const uint32_t states_len = opt->states_len - (last - first) + pushes;
+  optimize_reserve(opt, states_len);
+  memmove(&opt->states[first + pushes], &opt->states[last],
+          (opt->states_len - last) * sizeof(SolverNode));
+  opt->states_len = states_len;
+  for (uint32_t i = found_i, p = pushes; p > 0; i = solver->nodes[i].parent)
+    opt->states[first + p--] = solver->nodes[i];
+  return true;
+}
+
+static void optimize_pass(Optimizer *opt, OptimizeMetric metric) {
+  for (uint32_t first = 0; first + 1 < opt->states_len;) {
+    uint32_t last = first + OPTIMIZE_WINDOW;
+    if (last >= opt->states_len)
+      last = opt->states_len - 1;
+    // Try the same window again after an improvement.
+    if (!optimize_window(opt, metric, first, last))
+      first++;
+  }
+}
+
+static char *optimize_solution_of(const Optimizer *opt) {
+  const SolverNode **path =
+      malloc(opt->states_len * sizeof(const SolverNode *));
+  SDL_assert(path != 0);
+  for (uint32_t i = 0; i < opt->states_len; i++)
+    path[i] = &opt->states[i];
+  char *solution = solution_from_pushes(&opt->solver.layout, path,
+                                        opt->states_len - 1);
+  free(path);
+  return solution;
+}
+
+// Write to `*fewer_moves` and `*fewer_pushes` (heap allocated) the two
+// variants of `solution`, a solution of `map`, `width` by `height` cells.
+// Returns false if it is not one.
+static bool optimize_solution(const Entity *map, uint32_t width,
+                              uint32_t height, const char *solution,
+                              char **fewer_moves, char **fewer_pushes) {
+  SDL_assert(map != 0);
+  SDL_assert(solution != 0);
+  SDL_assert(fewer_moves != 0);
+  SDL_assert(fewer_pushes != 0);
+
+  Optimizer opt;
+  if (!optimize_init(&opt, map, width, height, solution)) {
+    optimize_destroy(&opt);
+    return false;
+  }
+
+  SolverNode *const states = malloc(opt.states_len * sizeof(SolverNode));
+  SDL_assert(states != 0);
+  const uint32_t states_len = opt.states_len;
+  __builtin_memcpy(states, opt.states, states_len * sizeof(SolverNode));
+
+  optimize_pass(&opt, OPTIMIZE_PUSHES);
+  *fewer_pushes = optimize_solution_of(&opt);
+
+  // Local searches: also start from the other variant, keep the best.
+  optimize_pass(&opt, OPTIMIZE_MOVES);
+  *fewer_moves = optimize_solution_of(&opt);
+  __builtin_memcpy(opt.states, states, states_len * sizeof(SolverNode));
+  opt.states_len = states_len;
+  optimize_pass(&opt, OPTIMIZE_MOVES);
+  char *const other = optimize_solution_of(&opt);
+  if (strlen(other) < strlen(*fewer_moves)) {
+    free(*fewer_moves);
+    *fewer_moves = other;
+  } else {
+    free(other);
+  }
+
+  free(states);
+  optimize_destroy(&opt);
+  return true;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+// Compact states for the solver. What never changes during a search (walls,
+// objectives) is kept once in a `PackedLayout`; a state is then only a bitset
+// of crates over the cells a crate can ever stand on, plus the character
+// cell. Dead squares are left out since no search keeps a crate there.
+
+#include "bitboard.h"
+
+// Cells a crate can stand on, at most: the most that a state packs, whatever
+// the size of the level.
+#define PACKED_WORDS 2
+#define PACKED_MAX_CELLS (PACKED_WORDS * 64)
+#define PACKED_NO_BIT UINT8_MAX
+
+typedef struct {
+  uint64_t crates[PACKED_WORDS];
+  uint16_t character_cell_i;
+  uint16_t region_i; // Push-level: smallest cell the character can walk to.
+} PackedState;
+
+// The level of a search: its size, and what never changes.
+typedef struct {
+  uint32_t width, size;
+  uint8_t words; // Of a `CellSet` of the level.
+  int32_t neighbours[4];
+  // Walls and objectives only, the floor outside the walls as walls.
+  Entity statics[MAP_MAX_SIZE];
+  CellSet walls;                 // Including the cells past the map.
+  uint8_t bit_of_cell[MAP_MAX_SIZE]; // `PACKED_NO_BIT` if no crate goes there.
+  uint16_t cell_of_bit[PACKED_MAX_CELLS];
+  uint8_t bits_len;
+  uint64_t objectives[PACKED_WORDS];
+} PackedLayout;
+
+// The layout of `map`, `width` by `height` cells, and its dead squares. One
+// bit per non-wall, non-dead cell. Cells holding a crate in `map` get one too,
+// dead or not, so that it can always be encoded. Returns false if the level is
+// too large or not walled in.
+static bool packed_layout_init(PackedLayout *layout, const Entity *map,
+                               uint32_t width, uint32_t height,
+                               CellSet *dead_squares) {
+  SDL_assert(layout != 0);
+  SDL_assert(map != 0);
+  SDL_assert(dead_squares != 0);
+
+  if (width > MAP_MAX_WIDTH || height > MAP_MAX_HEIGHT) {
+    fprintf(stderr, "Level of %ux%u, larger than the %dx%d of the solver\n",
+            width, height, MAP_MAX_WIDTH, MAP_MAX_HEIGHT);
+    return false;
+  }
+
+  CellSet inside;
+  uint32_t open_i = 0;
+  if (!map_is_enclosed(map, width, height, &open_i, inside.words)) {
+    fprintf(stderr, "Level not walled in at %u:%u\n", open_i / width + 1,
+            open_i % width + 1);
+    return false;
+  }
+
+  *layout = (PackedLayout){.width = width,
+                           .size = width * height,
+                           .words = BITMAP_WORDS(width * height)};
+  map_neighbours(width, layout->neighbours);
+  for (uint32_t i = 0; i < layout->size; i++)
+    layout->statics[i] = cellset_contains(&inside, i)
+                             ? map[i] & (ENTITY_WALL | ENTITY_OBJECTIVE)
+                             : ENTITY_WALL;
+  find_dead_squares(layout->statics, layout->size, layout->neighbours,
+                    dead_squares->words);
+  __builtin_memset(layout->bit_of_cell, PACKED_NO_BIT, layout->size);
+  cellset_walls(layout->statics, layout->size, &layout->walls);
+  for (uint32_t i = 0; i < layout->size; i++) {
+    if (bitset_contains(layout->statics[i], ENTITY_WALL) ||
+        (cellset_contains(dead_squares, i) &&
+         !bitset_contains(map[i], ENTITY_CRATE)))
+      continue;
+
+    if (layout->bits_len == PACKED_MAX_CELLS) {
+      fprintf(stderr, "Too many free cells to pack a state\n");
+      return false;
+    }
+    const uint8_t bit = layout->bits_len++;
+    layout->bit_of_cell[i] = bit;
+    layout->cell_of_bit[bit] = i;
+    if (bitset_contains(map[i], ENTITY_OBJECTIVE))
+      layout->objectives[bit / 64] |= (uint64_t)1 << (bit % 64);
+  }
+  return true;
+}
+
+static void packed_add_crate(const PackedLayout *layout, PackedState *state,
+                             uint32_t cell_i) {
+  const uint8_t bit = layout->bit_of_cell[cell_i];
+  SDL_assert(bit != PACKED_NO_BIT);
+  state->crates[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+static void packed_move_crate(const PackedLayout *layout, PackedState *state,
+                              uint32_t from, uint32_t to) {
+  const uint8_t bit = layout->bit_of_cell[from];
+  SDL_assert(bit != PACKED_NO_BIT);
+  state->crates[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+  packed_add_crate(layout, state, to);
+}
+
+static void pack_state(const PackedLayout *layout, const Entity *map,
+                       uint32_t character_cell_i, PackedState *state) {
+  SDL_assert(layout != 0);
+  SDL_assert(map != 0);
+  SDL_assert(state != 0);
+
+  *state = (PackedState){.character_cell_i = character_cell_i};
+  for (uint32_t i = 0; i < layout->size; i++) {
+    if (bitset_contains(map[i], ENTITY_CRATE))
+      packed_add_crate(layout, state, i);
+  }
+}
+
+static void unpack_state(const PackedLayout *layout, const PackedState *state,
+                         Entity *map) {
+  SDL_assert(layout != 0);
+  SDL_assert(state != 0);
+  SDL_assert(map != 0);
+
+  __builtin_memcpy(map, layout->statics, layout->size);
+  for (uint8_t w = 0; w < PACKED_WORDS; w++) {
+    for (uint64_t word = state->crates[w]; word; word &= word - 1) {
+      const uint8_t bit = w * 64 + __builtin_ctzll(word);
+      bitset_add(&map[layout->cell_of_bit[bit]], ENTITY_CRATE);
+    }
+  }
+  bitset_add(&map[state->character_cell_i], ENTITY_CHARACTER);
+}
+
+// Cells of `state` with neither a wall nor a crate.
+static void packed_free_cells(const PackedLayout *layout,
+                              const PackedState *state, CellSet *free) {
+  for (uint8_t w = 0; w < layout->words; w++)
+    free->words[w] = ~layout->walls.words[w];
+  for (uint8_t w = 0; w < PACKED_WORDS; w++) {
+    for (uint64_t word = state->crates[w]; word; word &= word - 1) {
+      const uint8_t bit = w * 64 + __builtin_ctzll(word);
+      cellset_remove(free, layout->cell_of_bit[bit]);
+    }
+  }
+}
+
+// `cellset_flood_fill()` on the cells of `layout`.
+static uint32_t packed_flood_fill(const PackedLayout *layout,
+                                  const CellSet *free, uint32_t from,
+                                  CellSet *reachable) {
+  return cellset_flood_fill(free, layout->words, layout->width, from,
+                            reachable);
+}
+// Every objective holds a crate.
+static bool packed_is_won(const PackedLayout *layout,
+                          const PackedState *state) {
+  for (uint8_t w = 0; w < PACKED_WORDS; w++) {
+    if ((state->crates[w] & layout->objectives[w]) != layout->objectives[w])
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+// Parallel push-level breadth-first search.
+//
+// The search goes layer by layer, so solutions stay push-optimal. Within a
+// layer, every worker owns a work-stealing deque of nodes to expand: it pops
+// from the bottom of its own and, once empty, steals from the top of the
+// others. Children go to a private list that becomes the worker's deque for
+// the next layer. Visited states live in one lock-free set shared by all
+// workers (see `visited.h`), keyed by the exact packed state.
+//
+// The search is cancelled between two layers.
+//
+// Nodes are never moved once written: each worker allocates them in fixed
+// size chunks, and a node id is the worker index plus the index in its
+// chunks.
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "search.h"
+#include "visited.h"
+
+#define PARALLEL_MAX_THREADS 64
+#define PARALLEL_CHUNK_BITS 16
+#define PARALLEL_NODE_BITS 26 // Per worker.
+#define PARALLEL_MAX_CHUNKS (1U << (PARALLEL_NODE_BITS - PARALLEL_CHUNK_BITS))
+
+// Chase-Lev deque of node ids. The owner pushes and pops at the bottom,
+// thieves steal at the top. Pushes only happen between layers, while nobody
+// steals, so growing can simply reallocate.
+typedef struct {
+  int64_t top, bottom;
+  uint32_t *items;
+  int64_t cap; // Power of two.
+} WorkDeque;
+
+static void work_deque_push(WorkDeque *deque, uint32_t item) {
+  const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  const int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  if (bottom - top >= deque->cap) {
+    const int64_t cap = deque->cap ? deque->cap * 2 : 1 << 10;
+    uint32_t *items = malloc(cap * sizeof(uint32_t));
+    SDL_assert(items != 0);
+    for (int64_t i = top; i < bottom; i++)
+      items[i & (cap - 1)] = deque->items[i & (deque->cap - 1)];
+    free(deque->items);
+    deque->items = items;
+    deque->cap = cap;
+  }
+
+  deque->items[bottom & (deque->cap - 1)] = item;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+}
+
+static bool work_deque_pop(WorkDeque *deque, uint32_t *item) {
+  const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (top > bottom) { // Empty.
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  *item = deque->items[bottom & (deque->cap - 1)];
+  if (top == bottom) { // Last item: race against thieves.
+    const bool won =
+        __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won;
+  }
+  return true;
+}
+
+static bool work_deque_steal(WorkDeque *deque, uint32_t *item) {
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom)
+    return false;
+
+  *item = deque->items[top & (deque->cap - 1)];
+  return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+typedef struct ParallelSolver ParallelSolver;
+
+typedef struct {
+  ParallelSolver *solver;
+  uint32_t index;
+  pthread_t thread;
+  SolverNode *chunks[PARALLEL_MAX_CHUNKS];
+  uint32_t nodes_len;
+  WorkDeque deque;
+  uint32_t *next; // Nodes of the next layer.
+  uint32_t next_len, next_cap;
+  SolverNode *children;
+  uint64_t nodes_expanded;
+  uint64_t rng;
+} ParallelWorker;
+
+struct ParallelSolver {
+  ParallelWorker workers[PARALLEL_MAX_THREADS];
+  uint32_t workers_len;
+  VisitedSet visited;
+  CellSet dead_squares;
+  Macros macros;
+  PackedLayout layout;
+  bool use_macros;
+  const bool *cancel; // May be 0.
+  pthread_barrier_t barrier;
+  uint64_t layer_remaining; // Nodes of the current layer not expanded yet.
+  uint64_t nodes_len;       // Over all workers.
+  uint32_t solved;          // Node id + 1 of a solved node, or 0.
+  bool done, limit_reached;
+};
+
+static SolverNode *parallel_node(ParallelSolver *solver, uint32_t id) {
+  const ParallelWorker *const worker =
+      &solver->workers[id >> PARALLEL_NODE_BITS];
+  const uint32_t i = id & ((1U << PARALLEL_NODE_BITS) - 1);
+  return &worker->chunks[i >> PARALLEL_CHUNK_BITS]
+                        [i & ((1U << PARALLEL_CHUNK_BITS) - 1)];
+}
+
+// Store `node` in the worker's chunks and return its id, or UINT32_MAX if
+// the worker is out of room.
+static uint32_t parallel_worker_store(ParallelWorker *worker,
+                                      const SolverNode *node) {
+  const uint32_t i = worker->nodes_len;
+  // The last index of the last worker would be `SOLVER_NO_PARENT`.
+  if (i == (1U << PARALLEL_NODE_BITS) - 1)
+    return UINT32_MAX;
+
+  SolverNode **const chunk = &worker->chunks[i >> PARALLEL_CHUNK_BITS];
+  if (!*chunk) {
+    *chunk = malloc(sizeof(SolverNode) << PARALLEL_CHUNK_BITS);
+    SDL_assert(*chunk != 0);
+  }
+  (*chunk)[i & ((1U << PARALLEL_CHUNK_BITS) - 1)] = *node;
+  worker->nodes_len++;
+  return (worker->index << PARALLEL_NODE_BITS) | i;
+}
+
+static void parallel_worker_add_next(ParallelWorker *worker, uint32_t id) {
+  if (worker->next_len == worker->next_cap) {
+    worker->next_cap = worker->next_cap ? worker->next_cap * 2 : 1 << 10;
+    worker->next = realloc(worker->next, worker->next_cap * sizeof(uint32_t));
+    SDL_assert(worker->next != 0);
+  }
+  worker->next[worker->next_len++] = id;
+}
+
+static void parallel_expand(ParallelWorker *worker, uint32_t id) {
+  ParallelSolver *const solver = worker->solver;
+  const SolverNode *const node = parallel_node(solver, id);
+  if (packed_is_won(&solver->layout, &node->state)) {
+    uint32_t expected = 0;
+    __atomic_compare_exchange_n(&solver->solved, &expected, id + 1, false,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    return;
+  }
+  worker->nodes_expanded++;
+
+  const uint16_t children_len = push_successors(
+      &solver->layout, node, &solver->dead_squares,
+      solver->use_macros ? &solver->macros : 0, worker->children);
+  uint16_t stored = 0;
+  for (uint16_t i = 0; i < children_len; i++) {
+    SolverNode *const child = &worker->children[i];
+    const VisitedResult res =
+        visited_insert(&solver->visited, push_state_key(child));
+    if (res == VISITED_PRESENT)
+      continue;
+    if (res == VISITED_FULL) {
+      __atomic_store_n(&solver->limit_reached, true, __ATOMIC_RELAXED);
+      return;
+    }
+
+    child->parent = id;
+    const uint32_t child_id = parallel_worker_store(worker, child);
+    if (child_id == UINT32_MAX) {
+      __atomic_store_n(&solver->limit_reached, true, __ATOMIC_RELAXED);
+      return;
+    }
+    parallel_worker_add_next(worker, child_id);
+    stored++;
+  }
+  __atomic_add_fetch(&solver->nodes_len, stored, __ATOMIC_RELAXED);
+}
+
+static bool parallel_worker_take(ParallelWorker *worker, uint32_t *id) {
+  if (work_deque_pop(&worker->deque, id))
+    return true;
+
+  // Steal, starting from a random victim.
+  ParallelSolver *const solver = worker->solver;
+  const uint32_t first = splitmix64(&worker->rng) % solver->workers_len;
+  for (uint32_t i = 0; i < solver->workers_len; i++) {
+    ParallelWorker *const victim =
+        &solver->workers[(first + i) % solver->workers_len];
+    if (victim != worker && work_deque_steal(&victim->deque, id))
+      return true;
+  }
+  return false;
+}
+
+// Run by the first worker between two layers, while the others wait.
+static void parallel_next_layer(ParallelSolver *solver) {
+  uint64_t layer_len = 0;
+  for (uint32_t w = 0; w < solver->workers_len; w++) {
+    ParallelWorker *const worker = &solver->workers[w];
+    worker->deque.top = worker->deque.bottom = 0;
+    for (uint32_t i = 0; i < worker->next_len; i++)
+      work_deque_push(&worker->deque, worker->next[i]);
+    layer_len += worker->next_len;
+    worker->next_len = 0;
+  }
+
+  if (solver->nodes_len > SOLVER_MAX_NODES)
+    solver->limit_reached = true;
+  solver->layer_remaining = layer_len;
+  solver->done = solver->solved || solver->limit_reached || layer_len == 0 ||
+                 (solver->cancel &&
+                  __atomic_load_n(solver->cancel, __ATOMIC_RELAXED));
+}
+
+static void *parallel_worker_run(void *arg) {
+  ParallelWorker *const worker = arg;
+  ParallelSolver *const solver = worker->solver;
+
+  while (true) {
+    while (__atomic_load_n(&solver->layer_remaining, __ATOMIC_ACQUIRE) > 0 &&
+           !__atomic_load_n(&solver->solved, __ATOMIC_RELAXED) &&
+           !__atomic_load_n(&solver->limit_reached, __ATOMIC_RELAXED)) {
+      uint32_t id;
+      if (!parallel_worker_take(worker, &id)) {
+        sched_yield();
+        continue;
+      }
+      parallel_expand(worker, id);
+      __atomic_sub_fetch(&solver->layer_remaining, 1, __ATOMIC_RELEASE);
+    }
+
+    pthread_barrier_wait(&solver->barrier);
+    if (worker->index == 0)
+      parallel_next_layer(solver);
+    pthread_barrier_wait(&solver->barrier);
+    if (solver->done)
+      return 0;
+  }
+}
+
+static char *parallel_backtrack(ParallelSolver *solver, uint32_t id) {
+  uint32_t pushes = 0;
+  for (uint32_t i = id; parallel_node(solver, i)->parent != SOLVER_NO_PARENT;
+       i = parallel_node(solver, i)->parent)
+    pushes++;
+
+  const SolverNode **path = malloc((pushes + 1) * sizeof(SolverNode *));
+  SDL_assert(path != 0);
+  uint32_t i = id;
+  for (uint32_t p = pushes + 1; p > 0; p--) {
+    path[p - 1] = parallel_node(solver, i);
+    i = path[p - 1]->parent;
+  }
+
+  char *solution = solution_from_pushes(&solver->layout, path, pushes);
+  free(path);
+  return solution;
+}
+
+static void solve_parallel(const Entity *map, uint32_t width, uint32_t height,
+                           uint32_t threads, size_t visited_bytes,
+                           bool use_macros, const bool *cancel,
+                           SolverStats *stats) {
+  SDL_assert(map != 0);
+  SDL_assert(threads >= 1 && threads <= PARALLEL_MAX_THREADS);
+  SDL_assert(stats != 0);
+
+  *stats = (SolverStats){0};
+  const double start = now_s();
+
+  ParallelSolver *solver = calloc(1, sizeof(ParallelSolver));
+  SDL_assert(solver != 0);
+  SolverNode root;
+  uint32_t crates_count = 0, objectives_count = 0;
+  solver->use_macros = use_macros;
+  solver->cancel = cancel;
+  if (!solver_load(map, width, height, &crates_count, &objectives_count,
+                   &solver->dead_squares, &solver->macros, &solver->layout,
+                   &root) ||
+      !push_state_key_fits(&solver->layout)) {
+    free(solver);
+    return;
+  }
+  if (!visited_init(&solver->visited, visited_bytes)) {
+    fprintf(stderr, "Failed to allocate the visited states table\n");
+    free(solver);
+    return;
+  }
+  push_root_init(&solver->layout, &root);
+
+  solver->workers_len = threads;
+  for (uint32_t w = 0; w < threads; w++) {
+    ParallelWorker *const worker = &solver->workers[w];
+    worker->solver = solver;
+    worker->index = w;
+    worker->rng = w;
+    worker->children = malloc(SOLVER_MAX_SUCCESSORS * sizeof(SolverNode));
+    SDL_assert(worker->children != 0);
+  }
+  visited_insert(&solver->visited, push_state_key(&root));
+  parallel_worker_add_next(&solver->workers[0],
+                           parallel_worker_store(&solver->workers[0], &root));
+  solver->nodes_len = 1;
+  parallel_next_layer(solver);
+
+  pthread_barrier_init(&solver->barrier, 0, threads);
+  for (uint32_t w = 1; w < threads; w++)
+    pthread_create(&solver->workers[w].thread, 0, parallel_worker_run,
+                   &solver->workers[w]);
+  parallel_worker_run(&solver->workers[0]);
+  for (uint32_t w = 1; w < threads; w++)
+    pthread_join(solver->workers[w].thread, 0);
+  pthread_barrier_destroy(&solver->barrier);
+
+  if (solver->solved)
+    stats->solution = parallel_backtrack(solver, solver->solved - 1);
+  else
+    stats->limit_reached = solver->limit_reached;
+
+  for (uint32_t w = 0; w < threads; w++) {
+    ParallelWorker *const worker = &solver->workers[w];
+    stats->nodes_expanded += worker->nodes_expanded;
+    for (uint32_t c = 0; c < PARALLEL_MAX_CHUNKS; c++)
+      free(worker->chunks[c]);
+    free(worker->deque.items);
+    free(worker->next);
+    free(worker->children);
+  }
+  if (stats->solution)
+    solver_count_moves(stats->solution, stats);
+
+  stats->elapsed_s = now_s() - start;
+  stats->peak_memory_kib = peak_memory_kib();
+  stats->visited = visited_stats(&solver->visited);
+  visited_destroy(&solver->visited);
+  free(solver);
+}
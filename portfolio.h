@@ -0,0 +1,119 @@
+#pragma once
+
+// Several searches raced on the same level, one thread each. Which one is
+// fastest depends on the level: the first solution found wins, and the others
+// are told to stop (`SolverOptions.cancel`), which they check once per node.
+// So does a complete search that runs out of nodes without a solution: the
+// level has none. The memory given to the solver is split between them.
+
+#include <pthread.h>
+
+#include "solver.h"
+
+static const SearchMode PORTFOLIO_MODES[] = {
+    SEARCH_PUSHES, SEARCH_GREEDY, SEARCH_ASTAR, SEARCH_IDASTAR,
+    SEARCH_BIDIRECTIONAL,
+};
+#define PORTFOLIO_LEN (sizeof(PORTFOLIO_MODES) / sizeof(PORTFOLIO_MODES[0]))
+
+typedef struct Portfolio Portfolio;
+
+typedef struct {
+  Portfolio *portfolio;
+  pthread_t thread;
+  SolverOptions options;
+  SolverStats stats;
+} PortfolioRun;
+
+struct Portfolio {
+  const Entity *map;
+  uint32_t width, height;
+  PortfolioRun runs[PORTFOLIO_LEN];
+  // Index + 1 of the first run with a solution, or that found none, or 0.
+  uint32_t winner;
+  bool done; // The `cancel` flag of every run.
+};
+
+// Whether `run` tried every position, and found no solution in any.
+static bool portfolio_run_is_exhaustive(const PortfolioRun *run) {
+  // Macros skip positions, and `SEARCH_IDASTAR` is only trusted with
+  // solutions.
+  return !run->options.macros && !run->stats.limit_reached &&
+         !__atomic_load_n(&run->portfolio->done, __ATOMIC_RELAXED) &&
+         run->options.mode != SEARCH_IDASTAR;
+}
+
+static void *portfolio_run(void *arg) {
+  PortfolioRun *const run = arg;
+  Portfolio *const portfolio = run->portfolio;
+  solve(portfolio->map, portfolio->width, portfolio->height, &run->options,
+        &run->stats);
+  if (!run->stats.solution && !portfolio_run_is_exhaustive(run))
+    return 0;
+
+  uint32_t expected = 0;
+  __atomic_compare_exchange_n(&portfolio->winner, &expected,
+                              (uint32_t)(run - portfolio->runs) + 1, false,
+                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+  __atomic_store_n(&portfolio->done, true, __ATOMIC_RELAXED);
+  return 0;
+}
+
+// Like `solve()`, with every search of `PORTFOLIO_MODES` at once. Reports the
+// runs to stderr. `stats` are those of the winner.
+static void solve_portfolio(const Entity *map, uint32_t width,
+                            uint32_t height, const SolverOptions *options,
+                            SolverStats *stats) {
+  SDL_assert(map != 0);
+  SDL_assert(options != 0);
+  SDL_assert(stats != 0);
+
+  Portfolio *portfolio = calloc(1, sizeof(Portfolio));
+  SDL_assert(portfolio != 0);
+  portfolio->map = map;
+  portfolio->width = width;
+  portfolio->height = height;
+  for (uint32_t r = 0; r < PORTFOLIO_LEN; r++) {
+    PortfolioRun *const run = &portfolio->runs[r];
+    run->portfolio = portfolio;
+    run->options = *options;
+    run->options.mode = PORTFOLIO_MODES[r];
+    run->options.threads = 1;
+    run->options.ram_bytes = options->ram_bytes / PORTFOLIO_LEN;
+    run->options.cancel = &portfolio->done;
+    pthread_create(&run->thread, 0, portfolio_run, run);
+  }
+
+  const double start = now_s();
+  for (uint32_t r = 0; r < PORTFOLIO_LEN; r++)
+    pthread_join(portfolio->runs[r].thread, 0);
+  const double elapsed_s = now_s() - start;
+
+  *stats = (SolverStats){0};
+  for (uint32_t r = 0; r < PORTFOLIO_LEN; r++) {
+    PortfolioRun *const run = &portfolio->runs[r];
+    const bool won = portfolio->winner == r + 1;
+    const char *result = run->stats.solution       ? "solved"
+                         : won                      ? "no solution"
+                         : portfolio->done          ? "cancelled"
+                         : run->stats.limit_reached ? "gave up"
+                                                    : "no solution";
+    fprintf(stderr, "%-8s %-11s %10llu nodes %8.3f s%s\n",
+            SEARCH_NAMES[run->options.mode], result,
+            (unsigned long long)run->stats.nodes_expanded,
+            run->stats.elapsed_s, won ? "  won" : "");
+
+    if (won)
+      *stats = run->stats;
+    else
+      free(run->stats.solution);
+  }
+  if (!portfolio->winner) {
+    // Every run failed: report the first one.
+    stats->limit_reached = portfolio->runs[0].stats.limit_reached;
+    stats->nodes_expanded = portfolio->runs[0].stats.nodes_expanded;
+  }
+  stats->elapsed_s = elapsed_s;
+  stats->peak_memory_kib = peak_memory_kib();
+  free(portfolio);
+}
@@ -0,0 +1,504 @@
+#pragma once
+
+// Game rules, shared by the GUI and the solver so that they cannot drift.
+// See `collisions.md`.
+
+// The rules need nothing of SDL but its asserts: the headless library
+// (`sokoban.c`) takes them from the C library instead.
+#ifdef SOKOBAN_HEADLESS
+#include <assert.h>
+#define SDL_assert assert
+#define SDL_COMPILE_TIME_ASSERT(name, x)                                       \
+  typedef int sokoban_compile_time_assert_##name[(x)*2 - 1]
+#else
+#include <SDL.h>
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum { DIR_UP, DIR_RIGHT, DIR_DOWN, DIR_LEFT } Direction;
+typedef enum __attribute__((packed)) {
+  // Numbers do not matter, as long as `ENTITY_NONE` is 0.
+  ENTITY_NONE = 0,
+  ENTITY_WALL = 1 << 0,
+  ENTITY_OBJECTIVE = 1 << 1,
+  ENTITY_CRATE = 1 << 2,
+  ENTITY_CRATE_OK = (ENTITY_OBJECTIVE | ENTITY_CRATE), // Pseudo entity.
+  ENTITY_CHARACTER = 1 << 4,
+  ENTITY_MAX, // Not an entity.
+} Entity;
+
+// Outcome of a single step.
+typedef enum { GO_BLOCKED, GO_WALKED, GO_PUSHED, GO_PULLED } GoResult;
+
+static bool bitset_contains(Entity bitset, Entity b) {
+  return (bitset & b) == b;
+}
+static bool bitset_is_exactly(Entity bitset, Entity b) { return bitset == b; }
+static void bitset_remove(Entity *bitset, Entity b) { *bitset &= ~b; }
+static void bitset_add(Entity *bitset, Entity b) { *bitset |= b; }
+
+// Levels are any size, cells indexed row by row. The solver takes levels up to
+// this size: a row of bits of a `CellSet` is then less than a word, and a cell
+// index holds on 12 bits.
+#define MAP_MAX_WIDTH 60
+#define MAP_MAX_HEIGHT 60
+#define MAP_MAX_SIZE ((MAP_MAX_WIDTH) * (MAP_MAX_HEIGHT))
+SDL_COMPILE_TIME_ASSERT(map_row_fits_word, MAP_MAX_WIDTH < 64);
+SDL_COMPILE_TIME_ASSERT(map_cell_fits_12_bits, MAP_MAX_SIZE <= 1 << 12);
+
+// Offset to the next cell in each direction, for maps `width` wide.
+static void map_neighbours(uint32_t width, int32_t *neighbours) {
+  neighbours[DIR_UP] = -(int32_t)width;
+  neighbours[DIR_RIGHT] = 1;
+  neighbours[DIR_DOWN] = (int32_t)width;
+  neighbours[DIR_LEFT] = -1;
+}
+
+static Direction direction_opposite(Direction dir) { return (dir + 2) % 4; }
+
+// One bit per cell, for maps of any size.
+#define BITMAP_WORDS(cells) (((cells) + 63) / 64)
+
+static bool bitmap_contains(const uint64_t *words, uint32_t cell_i) {
+  return (words[cell_i / 64] >> (cell_i % 64)) & 1;
+}
+static void bitmap_add(uint64_t *words, uint32_t cell_i) {
+  words[cell_i / 64] |= (uint64_t)1 << (cell_i % 64);
+}
+static void bitmap_remove(uint64_t *words, uint32_t cell_i) {
+  words[cell_i / 64] &= ~((uint64_t)1 << (cell_i % 64));
+}
+
+// One bit per cell of a map of up to `MAP_MAX_SIZE` cells. Only the first
+// `BITMAP_WORDS()` words of the map are used.
+typedef struct {
+  uint64_t words[BITMAP_WORDS(MAP_MAX_SIZE)];
+} CellSet;
+
+static inline bool cellset_contains(const CellSet *set, uint32_t cell_i) {
+  return bitmap_contains(set->words, cell_i);
+}
+static void cellset_add(CellSet *set, uint32_t cell_i) {
+  bitmap_add(set->words, cell_i);
+}
+
+// Cells from which a crate can never reach an objective, whatever the other
+// crates do, on a map of `size` cells. Computed by pulling a crate backwards
+// from every objective: a crate on `t` may come from `s` next to it if the
+// character could stand on the far side of `s` to push it. Only walls matter
+// here. `dead_squares` is `BITMAP_WORDS(size)` long.
+static void find_dead_squares(const Entity *map, uint32_t size,
+                              const int32_t *neighbours,
+                              uint64_t *dead_squares) {
+  SDL_assert(map != 0);
+  SDL_assert(neighbours != 0);
+  SDL_assert(dead_squares != 0);
+
+  uint64_t *live = calloc(BITMAP_WORDS(size), sizeof(uint64_t));
+  uint32_t *stack = malloc(size * sizeof(uint32_t));
+  SDL_assert(live != 0);
+  SDL_assert(stack != 0);
+  uint32_t stack_len = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (bitset_contains(map[i], ENTITY_OBJECTIVE)) {
+      bitmap_add(live, i);
+      stack[stack_len++] = i;
+    }
+  }
+
+  while (stack_len > 0) {
+    const uint32_t cell_i = stack[--stack_len];
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const uint32_t from_i = cell_i + neighbours[dir];
+      const uint32_t character_i = from_i + neighbours[dir];
+      if (bitmap_contains(live, from_i) ||
+          bitset_contains(map[from_i], ENTITY_WALL) ||
+          bitset_contains(map[character_i], ENTITY_WALL))
+        continue;
+
+      bitmap_add(live, from_i);
+      stack[stack_len++] = from_i;
+    }
+  }
+
+  __builtin_memset(dead_squares, 0, BITMAP_WORDS(size) * sizeof(uint64_t));
+  for (uint32_t i = 0; i < size; i++) {
+    if (!bitset_contains(map[i], ENTITY_WALL) && !bitmap_contains(live, i))
+      bitmap_add(dead_squares, i);
+  }
+  free(live);
+  free(stack);
+}
+
+// Crates and objectives of a map of `size` cells, and where the character is.
+static void count_map(const Entity *map, uint32_t size, uint32_t *crates_count,
+                      uint32_t *objectives_count, uint32_t *character_cell_i) {
+  SDL_assert(map != 0);
+  SDL_assert(crates_count != 0);
+  SDL_assert(objectives_count != 0);
+  SDL_assert(character_cell_i != 0);
+
+  *crates_count = 0;
+  *objectives_count = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    const Entity cell = map[i];
+    SDL_assert(cell == ENTITY_NONE || cell == ENTITY_CHARACTER ||
+               cell == ENTITY_WALL || cell == ENTITY_OBJECTIVE ||
+               cell == ENTITY_CRATE || cell == ENTITY_CRATE_OK ||
+               cell == (ENTITY_CHARACTER | ENTITY_OBJECTIVE));
+
+    *crates_count += bitset_contains(cell, ENTITY_CRATE);
+    *objectives_count += bitset_contains(cell, ENTITY_OBJECTIVE);
+    if (bitset_contains(cell, ENTITY_CHARACTER))
+      *character_cell_i = i;
+  }
+}
+
+// Whether walls close in the character, the crates and the objectives of a
+// `width` by `height` map, so that no step, push or pull ever leaves it.
+// Returns false, with the first cell of the border they reach in `*open_i`,
+// if not. When enclosed, the floor cells inside the walls are set in
+// `inside`, `BITMAP_WORDS(width * height)` long, unless it is 0.
+static bool map_is_enclosed(const Entity *map, uint32_t width,
+                            uint32_t height, uint32_t *open_i,
+                            uint64_t *inside) {
+  SDL_assert(map != 0);
+  SDL_assert(open_i != 0);
+
+  const uint32_t size = width * height;
+  int32_t neighbours[4];
+  map_neighbours(width, neighbours);
+  uint64_t *seen = inside;
+  if (seen)
+    __builtin_memset(seen, 0, BITMAP_WORDS(size) * sizeof(uint64_t));
+  else
+    seen = calloc(BITMAP_WORDS(size), sizeof(uint64_t));
+  uint32_t *stack = malloc(size * sizeof(uint32_t));
+  SDL_assert(seen != 0);
+  SDL_assert(stack != 0);
+  uint32_t stack_len = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (map[i] & (ENTITY_CHARACTER | ENTITY_CRATE | ENTITY_OBJECTIVE)) {
+      bitmap_add(seen, i);
+      stack[stack_len++] = i;
+    }
+  }
+
+  bool enclosed = true;
+  while (stack_len > 0) {
+    const uint32_t cell_i = stack[--stack_len];
+    const uint32_t x = cell_i % width, y = cell_i / width;
+    if (x == 0 || y == 0 || x == width - 1 || y == height - 1) {
+      *open_i = cell_i;
+      enclosed = false;
+      break;
+    }
+
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const uint32_t next_cell_i = cell_i + neighbours[dir];
+      if (bitmap_contains(seen, next_cell_i) ||
+          bitset_contains(map[next_cell_i], ENTITY_WALL))
+        continue;
+
+      bitmap_add(seen, next_cell_i);
+      stack[stack_len++] = next_cell_i;
+    }
+  }
+  if (seen != inside)
+    free(seen);
+  free(stack);
+  return enclosed;
+}
+
+// The cell of the character `c` of a level, `#` a wall, ` `, `-` or `_` the
+// floor, `.` an objective, `$` a crate, `*` one on an objective, `@` the
+// character and `+` it on an objective. Returns false for anything else.
+static bool entity_from_char(int c, Entity *cell) {
+  switch (c) {
+  case '#':
+    *cell = ENTITY_WALL;
+    return true;
+  case ' ':
+  case '-':
+  case '_':
+    *cell = ENTITY_NONE;
+    return true;
+  case '.':
+    *cell = ENTITY_OBJECTIVE;
+    return true;
+  case '$':
+    *cell = ENTITY_CRATE;
+    return true;
+  case '*':
+    *cell = ENTITY_CRATE_OK;
+    return true;
+  case '@':
+    *cell = ENTITY_CHARACTER;
+    return true;
+  case '+':
+    *cell = ENTITY_CHARACTER | ENTITY_OBJECTIVE;
+    return true;
+  }
+  return false;
+}
+
+// Read a level in the usual text format (`#` wall, `@` character, `$` crate,
+// `.` objective, `*` crate on objective, `+` character on objective), of any
+// size: `*map` is heap allocated, `*width` by `*height` cells. Short lines are
+// padded with walls. Levels that are not walled in are rejected (see
+// `map_is_enclosed()`).
+static bool read_level(const char *path, Entity **map, uint32_t *width,
+                       uint32_t *height) {
+  SDL_assert(path != 0);
+  SDL_assert(map != 0);
+  SDL_assert(width != 0);
+  SDL_assert(height != 0);
+
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+
+  // The size first, then the cells.
+  uint32_t x = 0, y = 0;
+  *width = *height = 0;
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (c == '\r')
+      continue;
+    if (c == '\n') {
+      x = 0;
+      y++;
+      continue;
+    }
+    if (++x > *width)
+      *width = x;
+    *height = y + 1;
+  }
+  if (*width == 0) {
+    fprintf(stderr, "%s: empty level\n", path);
+    fclose(file);
+    return false;
+  }
+
+  *map = malloc((size_t)*width * *height);
+  SDL_assert(*map != 0);
+  __builtin_memset(*map, ENTITY_WALL, (size_t)*width * *height);
+
+  bool ok = true;
+  uint32_t characters_count = 0;
+  x = y = 0;
+  rewind(file);
+  while ((c = fgetc(file)) != EOF) {
+    if (c == '\r')
+      continue;
+    if (c == '\n') {
+      x = 0;
+      y++;
+      continue;
+    }
+
+    Entity *const cell = &(*map)[y * *width + x++];
+    if (!entity_from_char(c, cell)) {
+      fprintf(stderr, "%s:%u:%u: unknown cell `%c`\n", path, y + 1, x, c);
+      ok = false;
+    }
+    characters_count += bitset_contains(*cell, ENTITY_CHARACTER);
+    if (!ok)
+      break;
+  }
+  fclose(file);
+
+  if (ok && characters_count != 1) {
+    fprintf(stderr, "%s: expected exactly one character, got %u\n", path,
+            characters_count);
+    ok = false;
+  }
+  uint32_t open_i = 0;
+  if (ok && !map_is_enclosed(*map, *width, *height, &open_i, 0)) {
+    fprintf(stderr, "%s:%u:%u: level not walled in\n", path,
+            open_i / *width + 1, open_i % *width + 1);
+    ok = false;
+  }
+  if (!ok) {
+    free(*map);
+    *map = 0;
+  }
+  return ok;
+}
+
+// Mark the cells the character can walk to from `from` without pushing
+// anything, on a map of `size` cells with `neighbours` offsets (see
+// `map_neighbours()`). Returns the smallest such cell, which identifies the
+// region.
+static inline uint32_t flood_fill(const Entity *map, uint32_t size,
+                                  const int32_t *neighbours, uint32_t from,
+                                  bool *reachable) {
+  SDL_assert(map != 0);
+  SDL_assert(neighbours != 0);
+  SDL_assert(reachable != 0);
+  SDL_assert(size <= MAP_MAX_SIZE);
+
+  __builtin_memset(reachable, 0, size * sizeof(bool));
+  uint16_t stack[MAP_MAX_SIZE];
+  uint32_t stack_len = 0;
+  uint32_t min_cell_i = from;
+
+  reachable[from] = true;
+  stack[stack_len++] = from;
+  while (stack_len > 0) {
+    const uint32_t cell_i = stack[--stack_len];
+    if (cell_i < min_cell_i)
+      min_cell_i = cell_i;
+
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const uint32_t next_cell_i = cell_i + neighbours[dir];
+      const Entity next_cell = map[next_cell_i];
+      if (reachable[next_cell_i] || bitset_contains(next_cell, ENTITY_WALL) ||
+          bitset_contains(next_cell, ENTITY_CRATE))
+        continue;
+
+      reachable[next_cell_i] = true;
+      stack[stack_len++] = next_cell_i;
+    }
+  }
+  return min_cell_i;
+}
+
+// What a step does, by what is on the next cell and on the one after it
+// (walls, objectives and crates only): `collisions.md` as a table.
+#define GO_CELL (ENTITY_WALL | ENTITY_OBJECTIVE | ENTITY_CRATE)
+static const uint8_t GO_TABLE[GO_CELL + 1][GO_CELL + 1] = {
+    // MN, MO => Free pathing.
+    [ENTITY_NONE] = {GO_WALKED, GO_WALKED, GO_WALKED, GO_WALKED, GO_WALKED,
+                     GO_WALKED, GO_WALKED, GO_WALKED},
+    [ENTITY_OBJECTIVE] = {GO_WALKED, GO_WALKED, GO_WALKED, GO_WALKED,
+                          GO_WALKED, GO_WALKED, GO_WALKED, GO_WALKED},
+    // MCN, MCO => Advance the crate. MW, MCW, MCC => No pathing.
+    [ENTITY_CRATE] = {[ENTITY_NONE] = GO_PUSHED,
+                      [ENTITY_OBJECTIVE] = GO_PUSHED},
+    [ENTITY_CRATE_OK] = {[ENTITY_NONE] = GO_PUSHED,
+                         [ENTITY_OBJECTIVE] = GO_PUSHED},
+};
+
+// One step towards the cell `offset` away, on a map of any size. The cells are
+// only looked up in `GO_TABLE`; the one branch on them, whether there is a
+// crate to look past, is well predicted when replaying a solution.
+static GoResult go_by(int32_t offset, uint32_t *character_cell_i,
+                      Entity *map) {
+  const uint32_t cell_i = *character_cell_i;
+  const uint32_t next_cell_i = cell_i + offset;
+  const Entity next_cell = map[next_cell_i] & GO_CELL;
+  if (!bitset_contains(next_cell, ENTITY_CRATE)) {
+    const GoResult result = GO_TABLE[next_cell][ENTITY_NONE];
+    if (result == GO_BLOCKED)
+      return result;
+
+    bitset_remove(&map[cell_i], ENTITY_CHARACTER);
+    bitset_add(&map[next_cell_i], ENTITY_CHARACTER);
+    *character_cell_i = next_cell_i;
+    return result;
+  }
+
+  // A crate is never on the border: past it is still on the map.
+  const uint32_t next_next_cell_i = next_cell_i + offset;
+  const GoResult result =
+      GO_TABLE[next_cell][map[next_next_cell_i] & GO_CELL];
+  if (result == GO_BLOCKED)
+    return result;
+
+  bitset_remove(&map[cell_i], ENTITY_CHARACTER);
+  map[next_cell_i] ^= ENTITY_CRATE | ENTITY_CHARACTER;
+  bitset_add(&map[next_next_cell_i], ENTITY_CRATE);
+  *character_cell_i = next_cell_i;
+  return result;
+}
+
+// Direction => LURD letter, of a walk and of a push.
+static const char LURD_WALK[4] = {[DIR_UP] = 'u', [DIR_RIGHT] = 'r',
+                                  [DIR_DOWN] = 'd', [DIR_LEFT] = 'l'};
+static const char LURD_PUSH[4] = {[DIR_UP] = 'U', [DIR_RIGHT] = 'R',
+                                  [DIR_DOWN] = 'D', [DIR_LEFT] = 'L'};
+
+// LURD letter => 1 + direction, plus 4 for a push. 0 for anything else.
+static const uint8_t LURD_STEPS[256] = {
+    ['u'] = 1 + DIR_UP,     ['r'] = 1 + DIR_RIGHT,
+    ['d'] = 1 + DIR_DOWN,   ['l'] = 1 + DIR_LEFT,
+    ['U'] = 5 + DIR_UP,     ['R'] = 5 + DIR_RIGHT,
+    ['D'] = 5 + DIR_DOWN,   ['L'] = 5 + DIR_LEFT,
+};
+
+// Play the `moves_len` moves of `lurd` on a map with `neighbours` offsets (see
+// `map_neighbours()`). Stops at the first move that is not a LURD letter, or
+// that does not walk or push as its case says; the map is left as that move
+// left it. Returns how many moves were played as written.
+static inline size_t apply_moves(Entity *map, const int32_t *neighbours,
+                                 uint32_t *character_cell_i, const char *lurd,
+                                 size_t moves_len) {
+  SDL_assert(map != 0);
+  SDL_assert(neighbours != 0);
+  SDL_assert(character_cell_i != 0);
+  SDL_assert(lurd != 0);
+
+  size_t i = 0;
+  for (; i < moves_len; i++) {
+    const uint8_t step = LURD_STEPS[(uint8_t)lurd[i]];
+    if (step == 0)
+      break;
+    const GoResult expected = step > 4 ? GO_PUSHED : GO_WALKED;
+    if (go_by(neighbours[(step - 1) % 4], character_cell_i, map) != expected)
+      break;
+  }
+  return i;
+}
+
+// Reverse of a step of `go_by()` that was not blocked: the character steps
+// back, and brings back the crate if it pushed one. Searches going depth first
+// can play moves and take them back on a single map.
+static inline void go_back_by(int32_t offset, bool pushed,
+                              uint32_t *character_cell_i, Entity *map) {
+  const uint32_t cell_i = *character_cell_i;
+  const uint32_t previous_cell_i = cell_i - offset;
+  bitset_remove(&map[cell_i], ENTITY_CHARACTER);
+  bitset_add(&map[previous_cell_i], ENTITY_CHARACTER);
+  if (pushed) {
+    bitset_remove(&map[cell_i + offset], ENTITY_CRATE);
+    bitset_add(&map[cell_i], ENTITY_CRATE);
+  }
+  *character_cell_i = previous_cell_i;
+}
+
+// Reverse of `go_by()`, to search backwards from solved positions: the
+// character steps onto the free cell `offset` away and drags along the crate
+// behind it, if any.
+static inline GoResult pull_by(int32_t offset, uint32_t *character_cell_i,
+                               Entity *map) {
+  SDL_assert(character_cell_i != 0);
+  SDL_assert(map != 0);
+
+  const uint32_t cell_i = *character_cell_i;
+  const uint32_t next_cell_i = cell_i + offset;
+  Entity *const next_cell = &map[next_cell_i];
+  // MW, MC => No pathing.
+  if (!bitset_is_exactly(*next_cell, ENTITY_NONE) &&
+      !bitset_is_exactly(*next_cell, ENTITY_OBJECTIVE))
+    return GO_BLOCKED;
+
+  Entity *const cell = &map[cell_i];
+  Entity *const previous_cell = &map[cell_i - offset];
+  bitset_remove(cell, ENTITY_CHARACTER);
+  bitset_add(next_cell, ENTITY_CHARACTER);
+  *character_cell_i = next_cell_i;
+
+  // CMN, CMO => Drag the crate.
+  if (!bitset_contains(*previous_cell, ENTITY_CRATE))
+    return GO_WALKED;
+
+  bitset_remove(previous_cell, ENTITY_CRATE);
+  bitset_add(cell, ENTITY_CRATE);
+  return GO_PULLED;
+}
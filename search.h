@@ -0,0 +1,782 @@
+#pragma once
+
+// Building blocks of the solver (see `solver.h`): nodes, the successors of a
+// node, solution rebuilding, and the single-threaded searches.
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "deadlock.h"
+#include "heap.h"
+#include "heuristic.h"
+#include "macros.h"
+#include "packed.h"
+#include "rules.h"
+#include "visited.h"
+#include "zobrist.h"
+
+#define SOLVER_NO_PARENT UINT32_MAX
+// Give up past this many stored nodes rather than exhausting memory.
+#define SOLVER_MAX_NODES (1U << 23)
+// A push per direction for every crate, plus with macros one child per
+// objective of a goal room.
+#define SOLVER_MAX_SUCCESSORS (5 * PACKED_MAX_CELLS)
+// Default memory of the visited states table.
+#define SOLVER_TT_BYTES ((size_t)256 << 20)
+
+typedef struct {
+  // The character cell is exact, even for push-level searches.
+  PackedState state;
+  uint64_t hash; // See `zobrist.h`.
+  uint32_t parent;
+  uint16_t pushes; // Since the root.
+  char move;       // LURD letter that led to this node.
+} SolverNode;
+
+typedef struct {
+  SolverNode *nodes;
+  uint32_t nodes_len, nodes_cap;
+  TranspositionTable visited; // Node index by state hash.
+  CellSet dead_squares;
+  PackedLayout layout;
+  PushDistances distances;
+  Macros macros;
+  bool use_matching; // As many crates as objectives.
+  bool use_macros;
+  const bool *cancel; // The search gives up once it is true. May be 0.
+} Solver;
+
+typedef struct {
+  char *solution; // Heap allocated, 0 if no solution was found.
+  uint32_t moves, pushes;
+  uint64_t nodes_expanded;
+  bool limit_reached;
+  double elapsed_s;
+  long peak_memory_kib;
+  VisitedStats visited; // Only filled by the parallel search.
+} SolverStats;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static long peak_memory_kib(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss; // KiB on Linux.
+}
+
+static uint32_t solver_append(Solver *solver, const SolverNode *node) {
+  if (solver->nodes_len == solver->nodes_cap) {
+    solver->nodes_cap = solver->nodes_cap ? solver->nodes_cap * 2 : 1 << 12;
+    solver->nodes =
+        realloc(solver->nodes, solver->nodes_cap * sizeof(SolverNode));
+    SDL_assert(solver->nodes != 0);
+  }
+  solver->nodes[solver->nodes_len] = *node;
+  return solver->nodes_len++;
+}
+
+// Append `node` unless an identical state was already seen. Returns true if it
+// was added.
+static bool solver_push(Solver *solver, const SolverNode *node) {
+  if (!tt_insert(&solver->visited, node->hash, solver->nodes_len))
+    return false;
+
+  solver_append(solver, node);
+  return true;
+}
+
+static void solver_count_moves(const char *solution, SolverStats *stats) {
+  for (const char *move = solution; *move; move++) {
+    stats->moves++;
+    stats->pushes += *move >= 'A' && *move <= 'Z';
+  }
+}
+
+static char *solver_backtrack_moves(const Solver *solver, uint32_t node_i) {
+  uint32_t len = 0;
+  for (uint32_t i = node_i; solver->nodes[i].parent != SOLVER_NO_PARENT;
+       i = solver->nodes[i].parent)
+    len++;
+
+  char *solution = malloc(len + 1);
+  SDL_assert(solution != 0);
+  solution[len] = 0;
+  for (uint32_t i = node_i; solver->nodes[i].parent != SOLVER_NO_PARENT;
+       i = solver->nodes[i].parent)
+    solution[--len] = solver->nodes[i].move;
+  return solution;
+}
+
+// Shortest walk from `from` to `to` without pushing anything, written to `out`
+// (at least `layout->size` bytes). Returns its length, or -1 if unreachable.
+static int32_t walk_path(const PackedLayout *layout, const Entity *map,
+                         uint32_t from, uint32_t to, char *out) {
+  SDL_assert(layout != 0);
+  SDL_assert(map != 0);
+  SDL_assert(out != 0);
+
+  const int32_t *const neighbours = layout->neighbours;
+  // Direction used to enter each cell, `DIR_MAX` when not visited.
+  enum { DIR_MAX = DIR_LEFT + 1 };
+  uint8_t came_from[MAP_MAX_SIZE];
+  __builtin_memset(came_from, DIR_MAX, layout->size);
+  uint16_t queue[MAP_MAX_SIZE];
+  uint32_t queue_head = 0, queue_len = 0;
+
+  came_from[from] = DIR_UP;
+  queue[queue_len++] = from;
+  while (queue_head < queue_len && came_from[to] == DIR_MAX) {
+    const uint32_t cell_i = queue[queue_head++];
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const uint32_t next_cell_i = cell_i + neighbours[dir];
+      const Entity next_cell = map[next_cell_i];
+      if (came_from[next_cell_i] != DIR_MAX ||
+          bitset_contains(next_cell, ENTITY_WALL) ||
+          bitset_contains(next_cell, ENTITY_CRATE))
+        continue;
+
+      came_from[next_cell_i] = dir;
+      queue[queue_len++] = next_cell_i;
+    }
+  }
+  if (came_from[to] == DIR_MAX)
+    return -1;
+
+  int32_t len = 0;
+  for (uint32_t cell_i = to; cell_i != from;
+       cell_i -= neighbours[came_from[cell_i]])
+    len++;
+  int32_t i = len;
+  for (uint32_t cell_i = to; cell_i != from;
+       cell_i -= neighbours[came_from[cell_i]])
+    out[--i] = LURD_WALK[came_from[cell_i]];
+  return len;
+}
+
+static Direction direction_from_lurd(char move) {
+  switch (move | 0x20) { // Lowercase.
+  case 'u':
+    return DIR_UP;
+  case 'r':
+    return DIR_RIGHT;
+  case 'd':
+    return DIR_DOWN;
+  default:
+    return DIR_LEFT;
+  }
+}
+
+// Cells of the crate that moved between `parent` and its child `node`.
+static void push_crate_move(const PackedLayout *layout,
+                            const SolverNode *parent, const SolverNode *node,
+                            uint32_t *from, uint32_t *to) {
+  for (uint8_t w = 0; w < PACKED_WORDS; w++) {
+    const uint64_t diff = parent->state.crates[w] ^ node->state.crates[w];
+    const uint64_t gone = diff & parent->state.crates[w];
+    const uint64_t came = diff & node->state.crates[w];
+    if (gone)
+      *from = layout->cell_of_bit[w * 64 + __builtin_ctzll(gone)];
+    if (came)
+      *to = layout->cell_of_bit[w * 64 + __builtin_ctzll(came)];
+  }
+}
+
+// Moves of the character from state `start` to state `state` of `paths`.
+static size_t crate_path_len(const CratePaths *paths, uint32_t start,
+                             uint32_t state) {
+  size_t len = 0;
+  for (uint32_t s = state; s != start; s = paths->previous[s])
+    len++;
+  return len;
+}
+
+// Write those moves to `out`, at least `crate_path_len()` long.
+static void crate_path_moves(const PackedLayout *layout,
+                             const CratePaths *paths, uint32_t start,
+                             uint32_t state, char *out) {
+  size_t i = crate_path_len(paths, start, state);
+  for (uint32_t s = state; s != start; s = paths->previous[s]) {
+    const uint32_t previous = paths->previous[s];
+    const uint32_t from = previous % layout->size, to = s % layout->size;
+    Direction dir = DIR_UP;
+    while (from + layout->neighbours[dir] != to)
+      dir++;
+    out[--i] = s / layout->size != previous / layout->size ? LURD_PUSH[dir]
+                                                           : LURD_WALK[dir];
+  }
+}
+
+// Rebuild the full LURD solution of a push-level search. `path` goes from the
+// root to the solved node, and holds `len + 1` nodes.
+static char *solution_from_pushes(const PackedLayout *layout,
+                                  const SolverNode *const *path,
+                                  uint32_t len) {
+  const size_t per_push = (size_t)layout->size + 1;
+  size_t solution_len = 0, solution_cap = len * per_push + 1;
+  char *solution = malloc(solution_cap);
+  SDL_assert(solution != 0);
+
+  CratePaths paths = {0};
+  for (uint32_t p = 1; p <= len; p++) {
+    const SolverNode *node = path[p];
+    const SolverNode *parent = path[p - 1];
+    uint32_t from = 0, to = 0;
+    push_crate_move(layout, parent, node, &from, &to);
+
+    Entity map[MAP_MAX_SIZE];
+    unpack_state(layout, &parent->state, map);
+    const Direction dir = direction_from_lurd(node->move);
+    if (node->state.character_cell_i == from &&
+        from + layout->neighbours[dir] == to) {
+      // A single push: walk behind the crate, then push.
+      const uint32_t origin_i = from - layout->neighbours[dir];
+      const int32_t walk_len =
+          walk_path(layout, map, parent->state.character_cell_i, origin_i,
+                    &solution[solution_len]);
+      SDL_assert(walk_len >= 0);
+      solution_len += walk_len;
+      solution[solution_len++] = node->move;
+      continue;
+    }
+
+    // A macro (see `macros.h`): the cheapest way to move that crate there.
+    if (!paths.cost)
+      crate_paths_init(layout, &paths);
+    crate_paths(layout, map, from, parent->state.character_cell_i, &paths);
+    const uint32_t start =
+        crate_path_state(layout, from, parent->state.character_cell_i);
+    const uint32_t state =
+        crate_path_state(layout, to, node->state.character_cell_i);
+    SDL_assert(paths.cost[state] != CRATE_PATH_NONE);
+    const size_t moves = crate_path_len(&paths, start, state);
+    // Room for the rest, at most a walk and a push each.
+    const size_t needed = solution_len + moves + (len - p) * per_push + 1;
+    if (needed > solution_cap) {
+      solution_cap = 2 * needed;
+      solution = realloc(solution, solution_cap);
+      SDL_assert(solution != 0);
+    }
+    crate_path_moves(layout, &paths, start, state, &solution[solution_len]);
+    solution_len += moves;
+  }
+  if (paths.cost)
+    crate_paths_destroy(&paths);
+  solution[solution_len] = 0;
+  return solution;
+}
+
+static char *solver_backtrack_pushes(const Solver *solver, uint32_t node_i) {
+  uint32_t pushes = 0;
+  for (uint32_t i = node_i; solver->nodes[i].parent != SOLVER_NO_PARENT;
+       i = solver->nodes[i].parent)
+    pushes++;
+
+  const SolverNode **path = malloc((pushes + 1) * sizeof(SolverNode *));
+  SDL_assert(path != 0);
+  uint32_t i = node_i;
+  for (uint32_t p = pushes + 1; p > 0; p--, i = solver->nodes[i].parent)
+    path[p - 1] = &solver->nodes[i];
+
+  char *solution = solution_from_pushes(&solver->layout, path, pushes);
+  free(path);
+  return solution;
+}
+
+// Child of `node` where the crate on `from` ended on `to`, the character on
+// `character_cell_i`. `crates_hash` is the hash of the crates of `node` alone.
+// The move and the pushes are left to the caller.
+static void push_child_init(const PackedLayout *layout, const SolverNode *node,
+                            uint64_t crates_hash, uint32_t from, uint32_t to,
+                            uint32_t character_cell_i, SolverNode *child) {
+  *child = *node;
+  packed_move_crate(layout, &child->state, from, to);
+  child->state.character_cell_i = character_cell_i;
+  CellSet free, reachable;
+  packed_free_cells(layout, &child->state, &free);
+  const uint32_t region_i =
+      packed_flood_fill(layout, &free, character_cell_i, &reachable);
+  child->hash = zobrist_move_crate(crates_hash, from, to) ^
+                zobrist_keys.character[region_i];
+  child->state.region_i = region_i;
+}
+
+// The crate on `*crate_i` was just pushed towards `dir`: while it is in a
+// tunnel with the character behind it, push it on. Stops short of a deadlock.
+// Returns the extra pushes.
+static uint16_t push_through_tunnel(const PackedLayout *layout,
+                                    const Macros *macros,
+                                    const CellSet *dead_squares, Direction dir,
+                                    Entity *map, uint32_t *character_cell_i,
+                                    uint32_t *crate_i) {
+  const CellSet *const tunnel = &macros->tunnels[macros_axis(dir)];
+  const int32_t offset = layout->neighbours[dir];
+  uint16_t pushes = 0;
+  while (cellset_contains(tunnel, *crate_i) &&
+         cellset_contains(tunnel, *character_cell_i)) {
+    if (go_by(offset, character_cell_i, map) != GO_PUSHED)
+      break;
+
+    const uint32_t next_crate_i = *crate_i + offset;
+    if (push_is_deadlock(map, layout->neighbours, layout->words, dead_squares,
+                         next_crate_i)) {
+      go_back_by(offset, true, character_cell_i, map);
+      break;
+    }
+    *crate_i = next_crate_i;
+    pushes++;
+  }
+  return pushes;
+}
+
+// The crate on `crate_i` was just pushed through the door of its goal room,
+// the character standing on the door: one child per empty objective of the
+// room the crate can reach, the character ending where it is cheapest. `from`
+// is the cell of the crate in `node`. Returns how many children there are.
+static uint16_t push_into_goal_room(const PackedLayout *layout,
+                                    const SolverNode *node,
+                                    const CellSet *dead_squares,
+                                    const Macros *macros, uint64_t crates_hash,
+                                    const Entity *map, uint32_t from,
+                                    uint32_t crate_i,
+                                    uint32_t character_cell_i,
+                                    SolverNode *children) {
+  CratePaths paths;
+  crate_paths_init(layout, &paths);
+  crate_paths(layout, map, crate_i, character_cell_i, &paths);
+
+  uint16_t children_len = 0;
+  for (uint32_t objective_i = 0; objective_i < layout->size; objective_i++) {
+    if (macros->room_of[objective_i] != macros->room_of[crate_i] ||
+        !bitset_contains(map[objective_i], ENTITY_OBJECTIVE) ||
+        (objective_i != crate_i &&
+         bitset_contains(map[objective_i], ENTITY_CRATE)))
+      continue;
+
+    const uint32_t *const costs =
+        &paths.cost[crate_path_state(layout, objective_i, 0)];
+    uint32_t cost = CRATE_PATH_NONE, end_i = 0;
+    for (uint32_t i = 0; i < layout->size; i++) {
+      if (costs[i] < cost) {
+        cost = costs[i];
+        end_i = i;
+      }
+    }
+    if (cost == CRATE_PATH_NONE)
+      continue;
+
+    Entity child_map[MAP_MAX_SIZE];
+    __builtin_memcpy(child_map, map, layout->size);
+    bitset_remove(&child_map[crate_i], ENTITY_CRATE);
+    bitset_add(&child_map[objective_i], ENTITY_CRATE);
+    bitset_remove(&child_map[character_cell_i], ENTITY_CHARACTER);
+    bitset_add(&child_map[end_i], ENTITY_CHARACTER);
+    if (push_is_deadlock(child_map, layout->neighbours, layout->words,
+                         dead_squares, objective_i))
+      continue;
+
+    SolverNode *const child = &children[children_len++];
+    push_child_init(layout, node, crates_hash, from, objective_i, end_i,
+                    child);
+    child->pushes = cost / CRATE_PATH_PUSH;
+  }
+  crate_paths_destroy(&paths);
+  return children_len;
+}
+
+// Write the nodes reachable from `node` with one push to `children` (at least
+// `SOLVER_MAX_SUCCESSORS` long) and return how many there are. Pushes into a
+// deadlock are skipped. With `macros`, tunnels are gone through in one child
+// and pushes into goal rooms get extra children (see `macros.h`). The parent
+// of the children is left to the caller.
+static uint16_t push_successors(const PackedLayout *layout,
+                                const SolverNode *node,
+                                const CellSet *dead_squares,
+                                const Macros *macros, SolverNode *children) {
+  uint16_t children_len = 0;
+  Entity map[MAP_MAX_SIZE];
+  unpack_state(layout, &node->state, map);
+  CellSet free, reachable;
+  packed_free_cells(layout, &node->state, &free);
+  const uint32_t region_i = packed_flood_fill(
+      layout, &free, node->state.character_cell_i, &reachable);
+  // Hash of the crates alone.
+  const uint64_t crates_hash = node->hash ^ zobrist_keys.character[region_i];
+
+  // Crates by bit, that is by cell.
+  for (uint8_t bit = 0; bit < layout->bits_len; bit++) {
+    const uint32_t crate_i = layout->cell_of_bit[bit];
+    if (!bitset_contains(map[crate_i], ENTITY_CRATE))
+      continue;
+
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const int32_t offset = layout->neighbours[dir];
+      uint32_t character_cell_i = crate_i - offset;
+      if (!cellset_contains(&reachable, character_cell_i))
+        continue;
+
+      // Teleport the character behind the crate, then let `go_by()` decide.
+      Entity child_map[MAP_MAX_SIZE];
+      __builtin_memcpy(child_map, map, layout->size);
+      bitset_remove(&child_map[node->state.character_cell_i],
+                    ENTITY_CHARACTER);
+      bitset_add(&child_map[character_cell_i], ENTITY_CHARACTER);
+      if (go_by(offset, &character_cell_i, child_map) != GO_PUSHED)
+        continue;
+
+      uint32_t new_crate_i = crate_i + offset;
+      if (push_is_deadlock(child_map, layout->neighbours, layout->words,
+                           dead_squares, new_crate_i))
+        continue;
+
+      uint16_t pushes = 1;
+      if (macros) {
+        pushes += push_through_tunnel(layout, macros, dead_squares, dir,
+                                      child_map, &character_cell_i,
+                                      &new_crate_i);
+        const uint8_t room = macros->room_of[new_crate_i];
+        if (room && macros->doors[room - 1] == character_cell_i) {
+          const uint16_t room_len = push_into_goal_room(
+              layout, node, dead_squares, macros, crates_hash, child_map,
+              crate_i, new_crate_i, character_cell_i, &children[children_len]);
+          for (uint16_t i = children_len; i < children_len + room_len; i++) {
+            children[i].move = LURD_PUSH[dir];
+            children[i].pushes += node->pushes + pushes;
+          }
+          children_len += room_len;
+        }
+      }
+
+      SolverNode *const child = &children[children_len++];
+      push_child_init(layout, node, crates_hash, crate_i, new_crate_i,
+                      character_cell_i, child);
+      child->move = LURD_PUSH[dir];
+      child->pushes = node->pushes + pushes;
+    }
+  }
+  SDL_assert(children_len <= SOLVER_MAX_SUCCESSORS);
+  return children_len;
+}
+
+// Region and hash of a push-level root node.
+static void push_root_init(const PackedLayout *layout, SolverNode *root) {
+  Entity map[MAP_MAX_SIZE];
+  unpack_state(layout, &root->state, map);
+  CellSet free, reachable;
+  packed_free_cells(layout, &root->state, &free);
+  root->state.region_i = packed_flood_fill(
+      layout, &free, root->state.character_cell_i, &reachable);
+  root->hash = zobrist_hash(map, layout->size, root->state.region_i);
+}
+
+// Build the packed layout of `map`, `width` by `height` cells, count it, pack
+// `map` into `root` and find the macros.
+static bool solver_load(const Entity *map, uint32_t width, uint32_t height,
+                        uint32_t *crates_count, uint32_t *objectives_count,
+                        CellSet *dead_squares, Macros *macros,
+                        PackedLayout *layout, SolverNode *root) {
+  if (!packed_layout_init(layout, map, width, height, dead_squares))
+    return false;
+
+  uint32_t character_cell_i = 0;
+  count_map(map, layout->size, crates_count, objectives_count,
+            &character_cell_i);
+  *root = (SolverNode){.parent = SOLVER_NO_PARENT};
+  pack_state(layout, map, character_cell_i, &root->state);
+  // Walled in: no search looks past the walls.
+  Entity walled[MAP_MAX_SIZE];
+  unpack_state(layout, &root->state, walled);
+  compute_macros(layout, walled, character_cell_i, macros);
+  return true;
+}
+
+// Crates and region of a push-level node as one exact key: 12 bits of region
+// below the bit `visited_key()` takes, and under them room for
+// `PUSH_STATE_KEY_BITS` crate bits.
+#define PUSH_STATE_KEY_REGION_SHIFT 51
+#define PUSH_STATE_KEY_BITS (64 + PUSH_STATE_KEY_REGION_SHIFT)
+SDL_COMPILE_TIME_ASSERT(push_state_key_fits,
+                        PACKED_WORDS <= 2 && MAP_MAX_SIZE <= 1 << 12);
+static VisitedKey push_state_key(const SolverNode *node) {
+  uint64_t words[2] = {0};
+  __builtin_memcpy(words, node->state.crates, sizeof(node->state.crates));
+  return visited_key(words[0],
+                     words[1] | (uint64_t)node->state.region_i
+                                    << PUSH_STATE_KEY_REGION_SHIFT);
+}
+
+// Whether every state of `layout` has a `push_state_key()`.
+static bool push_state_key_fits(const PackedLayout *layout) {
+  if (layout->bits_len <= PUSH_STATE_KEY_BITS)
+    return true;
+
+  fprintf(stderr, "Too many free cells for this search: %u, at most %d\n",
+          layout->bits_len, PUSH_STATE_KEY_BITS);
+  return false;
+}
+
+// Reverse of `push_state_key()`. The character stands on the smallest cell of
+// its region.
+static SolverNode push_state_from_key(VisitedKey key) {
+  const uint64_t words[2] = {
+      key.lo, key.hi & (((uint64_t)1 << PUSH_STATE_KEY_REGION_SHIFT) - 1)};
+  SolverNode node = {.parent = SOLVER_NO_PARENT};
+  __builtin_memcpy(node.state.crates, words, sizeof(node.state.crates));
+  node.state.region_i = node.state.character_cell_i =
+      (uint16_t)(key.hi >> PUSH_STATE_KEY_REGION_SHIFT & 0xfff);
+  return node;
+}
+
+static bool solver_init(Solver *solver, const Entity *map, uint32_t width,
+                        uint32_t height, size_t tt_bytes, bool use_macros,
+                        SolverNode *root) {
+  *solver = (Solver){.use_macros = use_macros};
+  uint32_t crates_count = 0, objectives_count = 0;
+  if (!solver_load(map, width, height, &crates_count, &objectives_count,
+                   &solver->dead_squares, &solver->macros, &solver->layout,
+                   root))
+    return false;
+  if (!tt_init(&solver->visited, tt_bytes)) {
+    fprintf(stderr, "Failed to allocate the visited states table\n");
+    return false;
+  }
+
+  compute_push_distances(&solver->layout, solver->layout.statics,
+                         &solver->distances);
+  solver->use_matching = crates_count == objectives_count;
+  return true;
+}
+
+static void solver_destroy(Solver *solver) {
+  free(solver->nodes);
+  tt_destroy(&solver->visited);
+  push_distances_destroy(&solver->distances);
+}
+
+// Read from any thread: set by another one to stop the search.
+static bool solver_cancelled(const Solver *solver) {
+  return solver->cancel && __atomic_load_n(solver->cancel, __ATOMIC_RELAXED);
+}
+
+// `push_successors()` with the macros of `solver`, if enabled.
+static uint16_t solver_successors(const Solver *solver,
+                                  const SolverNode *node,
+                                  SolverNode *children) {
+  return push_successors(&solver->layout, node, &solver->dead_squares,
+                         solver->use_macros ? &solver->macros : 0, children);
+}
+
+static void solve_moves(Solver *solver, SolverNode *root, SolverStats *stats) {
+  Entity map[MAP_MAX_SIZE];
+  unpack_state(&solver->layout, &root->state, map);
+  root->hash =
+      zobrist_hash(map, solver->layout.size, root->state.character_cell_i);
+  solver_push(solver, root);
+
+  // The nodes array doubles as the BFS queue.
+  for (uint32_t head = 0; head < solver->nodes_len; head++) {
+    if (packed_is_won(&solver->layout, &solver->nodes[head].state)) {
+      stats->solution = solver_backtrack_moves(solver, head);
+      break;
+    }
+    stats->nodes_expanded++;
+    if (solver_cancelled(solver))
+      break;
+
+    if (solver->nodes_len + 4 > SOLVER_MAX_NODES) {
+      stats->limit_reached = true;
+      break;
+    }
+
+    // Every move is played on `map`, then taken back.
+    unpack_state(&solver->layout, &solver->nodes[head].state, map);
+    for (Direction dir = DIR_UP; dir <= DIR_LEFT; dir++) {
+      const int32_t offset = solver->layout.neighbours[dir];
+      SolverNode child = solver->nodes[head];
+      const uint32_t from = child.state.character_cell_i;
+      uint32_t character_cell_i = from;
+      const GoResult res = go_by(offset, &character_cell_i, map);
+      if (res == GO_BLOCKED)
+        continue;
+      const bool pushed = res == GO_PUSHED;
+      const uint32_t crate_i = character_cell_i + offset;
+      const bool deadlock =
+          pushed && push_is_deadlock(map, solver->layout.neighbours,
+                                     solver->layout.words,
+                                     &solver->dead_squares, crate_i);
+      go_back_by(offset, pushed, &character_cell_i, map);
+      if (deadlock)
+        continue;
+
+      if (pushed)
+        packed_move_crate(&solver->layout, &child.state, from + offset,
+                          crate_i);
+      child.state.character_cell_i = from + offset;
+      child.hash = zobrist_go(child.hash, res, offset, from);
+      child.parent = head;
+      child.move = pushed ? LURD_PUSH[dir] : LURD_WALK[dir];
+      solver_push(solver, &child);
+    }
+  }
+}
+
+static void solve_pushes(Solver *solver, SolverNode *root,
+                         SolverStats *stats) {
+  push_root_init(&solver->layout, root);
+  solver_push(solver, root);
+
+  SolverNode *children = malloc(SOLVER_MAX_SUCCESSORS * sizeof(SolverNode));
+  SDL_assert(children != 0);
+  for (uint32_t head = 0; head < solver->nodes_len; head++) {
+    if (packed_is_won(&solver->layout, &solver->nodes[head].state)) {
+      stats->solution = solver_backtrack_pushes(solver, head);
+      break;
+    }
+    stats->nodes_expanded++;
+    if (solver_cancelled(solver))
+      break;
+
+    if (solver->nodes_len + SOLVER_MAX_SUCCESSORS > SOLVER_MAX_NODES) {
+      stats->limit_reached = true;
+      break;
+    }
+
+    const uint16_t children_len =
+        solver_successors(solver, &solver->nodes[head], children);
+    for (uint16_t i = 0; i < children_len; i++) {
+      children[i].parent = head;
+      solver_push(solver, &children[i]);
+    }
+  }
+  free(children);
+}
+
+// A* keys: lowest f first, then lowest h, i.e. deepest. Greedy keys: lowest h
+// first, then fewest pushes.
+static uint64_t node_heap_key(bool greedy, uint32_t pushes, uint32_t h,
+                              uint32_t node_i) {
+  if (greedy)
+    return (uint64_t)h << 48 | (uint64_t)pushes << 32 | node_i;
+  return (uint64_t)(pushes + h) << 48 | (uint64_t)h << 32 | node_i;
+}
+
+static uint32_t node_heap_key_pushes(bool greedy, uint64_t key) {
+  if (greedy)
+    return (key >> 32) & 0xffff;
+  return (key >> 48) - ((key >> 32) & 0xffff);
+}
+
+// Room for the packed matching of every node, `size` bytes each.
+static void astar_matchings_reserve(const Solver *solver, uint8_t **matchings,
+                                    uint32_t *cap, size_t size) {
+  if (*cap >= solver->nodes_cap)
+    return;
+
+  *cap = solver->nodes_cap;
+  *matchings = realloc(*matchings, *cap * size);
+  SDL_assert(*matchings != 0);
+}
+
+// Best first on pushes so far plus the matching bound, or with `greedy` on the
+// bound alone: not push-optimal, but straight at the objectives.
+static void solve_astar(Solver *solver, SolverNode *root, bool greedy,
+                        SolverStats *stats) {
+  push_root_init(&solver->layout, root);
+  Entity map[MAP_MAX_SIZE];
+  Matching matching = {0};
+  uint32_t h = 0;
+  // The matching of each node, packed, to be repaired for its children.
+  uint8_t *matchings = 0;
+  uint32_t matchings_cap = 0;
+  const size_t matching_size =
+      matching_packed_size(solver->distances.objectives_len);
+  if (solver->use_matching) {
+    unpack_state(&solver->layout, &root->state, map);
+    matching_init(&matching, &solver->distances, map, solver->layout.size);
+    h = matching_cost(&matching, &solver->distances);
+    if (h == HEURISTIC_INFINITE)
+      return;
+  }
+  solver_push(solver, root);
+  if (solver->use_matching) {
+    astar_matchings_reserve(solver, &matchings, &matchings_cap, matching_size);
+    matching_pack(&matching, matchings);
+  }
+
+  NodeHeap open = {0};
+  node_heap_push(&open, node_heap_key(greedy, 0, h, 0));
+  SolverNode *children = malloc(SOLVER_MAX_SUCCESSORS * sizeof(SolverNode));
+  SDL_assert(children != 0);
+  while (open.len > 0) {
+    const uint64_t key = node_heap_pop(&open);
+    const uint32_t head = (uint32_t)key;
+    const uint32_t pushes = node_heap_key_pushes(greedy, key);
+    if (pushes != solver->nodes[head].pushes)
+      continue; // Reached again with fewer pushes since.
+
+    if (packed_is_won(&solver->layout, &solver->nodes[head].state)) {
+      stats->solution = solver_backtrack_pushes(solver, head);
+      break;
+    }
+    stats->nodes_expanded++;
+    if (solver_cancelled(solver))
+      break;
+
+    if (solver->nodes_len + SOLVER_MAX_SUCCESSORS > SOLVER_MAX_NODES) {
+      stats->limit_reached = true;
+      break;
+    }
+
+    if (solver->use_matching)
+      matching_unpack(&matching, &solver->distances,
+                      &matchings[head * matching_size]);
+
+    const uint16_t children_len =
+        solver_successors(solver, &solver->nodes[head], children);
+    for (uint16_t i = 0; i < children_len; i++) {
+      SolverNode *const child = &children[i];
+      child->parent = head;
+
+      uint32_t child_h = 0;
+      Matching child_matching;
+      if (solver->use_matching) {
+        child_matching = matching;
+        uint32_t from = 0, to = 0;
+        push_crate_move(&solver->layout, &solver->nodes[head], child, &from,
+                        &to);
+        matching_move_crate(&child_matching, &solver->distances, from, to);
+        child_h = matching_cost(&child_matching, &solver->distances);
+        if (child_h == HEURISTIC_INFINITE)
+          continue;
+      }
+
+      uint32_t child_i;
+      uint32_t *const existing = tt_find(&solver->visited, child->hash);
+      if (existing) {
+        child_i = *existing;
+        if (solver->nodes[child_i].pushes <= child->pushes)
+          continue;
+        solver->nodes[child_i] = *child;
+      } else {
+        child_i = solver->nodes_len;
+        if (!solver_push(solver, child))
+          continue;
+      }
+      if (solver->use_matching) {
+        astar_matchings_reserve(solver, &matchings, &matchings_cap,
+                                matching_size);
+        matching_pack(&child_matching, &matchings[child_i * matching_size]);
+      }
+      node_heap_push(&open,
+                     node_heap_key(greedy, child->pushes, child_h, child_i));
+    }
+  }
+  free(children);
+  free(open.items);
+  free(matchings);
+}
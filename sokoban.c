@@ -0,0 +1,251 @@
+// `libsokoban.a`: the API of `sokoban.h` over the headers of the game, built
+// with `SOKOBAN_HEADLESS`, without SDL.
+
+#include "sokoban.h"
+
+#include "batch.h"
+#include "level.h"
+#include "observe.h"
+#include "undo.h"
+
+SDL_COMPILE_TIME_ASSERT(sokoban_directions,
+                        (int)SOKOBAN_UP == DIR_UP &&
+                            (int)SOKOBAN_RIGHT == DIR_RIGHT &&
+                            (int)SOKOBAN_DOWN == DIR_DOWN &&
+                            (int)SOKOBAN_LEFT == DIR_LEFT);
+SDL_COMPILE_TIME_ASSERT(sokoban_steps, (int)SOKOBAN_BLOCKED == GO_BLOCKED &&
+                                           (int)SOKOBAN_WALKED == GO_WALKED &&
+                                           (int)SOKOBAN_PUSHED == GO_PUSHED);
+SDL_COMPILE_TIME_ASSERT(sokoban_observations,
+                        (int)SOKOBAN_GRID == OBSERVE_GRID &&
+                            (int)SOKOBAN_PLANES == OBSERVE_PLANES);
+SDL_COMPILE_TIME_ASSERT(sokoban_strides,
+                        sizeof(SokobanStrides) == sizeof(ObserveStrides));
+SDL_COMPILE_TIME_ASSERT(sokoban_cells,
+                        (int)SOKOBAN_WALL == ENTITY_WALL &&
+                            (int)SOKOBAN_OBJECTIVE == ENTITY_OBJECTIVE &&
+                            (int)SOKOBAN_CRATE == ENTITY_CRATE &&
+                            (int)SOKOBAN_CHARACTER == ENTITY_CHARACTER);
+
+struct SokobanGame {
+  Level level;
+  GameState state;
+  MoveLog log;
+  uint32_t dead_end_len; // Moves played up to the first dead end, or 0.
+  Entity *cells;         // `Level.size` long, for `sokoban_observe()`.
+};
+
+struct SokobanBatch {
+  Batch batch;
+};
+
+SokobanGame *sokoban_open(const char *path) {
+  SDL_assert(path != 0);
+
+  Entity *cells = 0;
+  uint32_t width = 0, height = 0;
+  if (!read_level(path, &cells, &width, &height))
+    return 0;
+
+  SokobanGame *const game = calloc(1, sizeof(SokobanGame));
+  SDL_assert(game != 0);
+  level_init(cells, width, height, &game->level);
+  free(cells);
+  game->cells = malloc(game->level.size);
+  SDL_assert(game->cells != 0);
+  game_state_init(&game->level, &game->state);
+  game_state_copy(&game->level, &game->state, &game->level.start);
+  return game;
+}
+
+void sokoban_close(SokobanGame *game) {
+  if (!game)
+    return;
+
+  game_state_destroy(&game->state);
+  level_destroy(&game->level);
+  free(game->log.moves);
+  free(game->cells);
+  free(game);
+}
+
+void sokoban_restart(SokobanGame *game) {
+  SDL_assert(game != 0);
+
+  game_state_copy(&game->level, &game->state, &game->level.start);
+  game->log.len = 0;
+  game->dead_end_len = 0;
+}
+
+// A push is a dead end for good: only undoing it gets out of it.
+static void sokoban_check_dead_end(SokobanGame *game, Direction dir) {
+  if (game->dead_end_len)
+    return;
+
+  const uint32_t crate_i =
+      game->state.character_cell_i + game->level.neighbours[dir];
+  if (game_push_is_deadlock(&game->level, &game->state, crate_i))
+    game->dead_end_len = game->log.len;
+}
+
+SokobanStep sokoban_step(SokobanGame *game, SokobanDirection dir) {
+  SDL_assert(game != 0);
+  SDL_assert(dir <= SOKOBAN_LEFT);
+
+  const GoResult result =
+      move_log_go(&game->log, &game->level, &game->state, (Direction)dir);
+  if (result == GO_PUSHED)
+    sokoban_check_dead_end(game, (Direction)dir);
+  return (SokobanStep)result;
+}
+
+uint32_t sokoban_play(SokobanGame *game, const char *lurd) {
+  SDL_assert(game != 0);
+  SDL_assert(lurd != 0);
+
+  uint32_t played = 0;
+  for (; lurd[played]; played++) {
+    const uint8_t step = LURD_STEPS[(uint8_t)lurd[played]];
+    if (!step)
+      break;
+    const Direction dir = (step - 1) % 4;
+    // A step pushes if there is a crate next: a push written as a walk, or
+    // the other way round, is not played, and the moves to redo are kept.
+    const uint32_t next_cell_i =
+        game->state.character_cell_i + game->level.neighbours[dir];
+    if (bitmap_contains(game->state.crates, next_cell_i) != (step > 4) ||
+        sokoban_step(game, (SokobanDirection)dir) == SOKOBAN_BLOCKED)
+      break;
+  }
+  return played;
+}
+
+bool sokoban_undo(SokobanGame *game) {
+  SDL_assert(game != 0);
+
+  if (!move_log_undo(&game->log, &game->level, &game->state))
+    return false;
+  if (game->log.len < game->dead_end_len)
+    game->dead_end_len = 0;
+  return true;
+}
+
+bool sokoban_redo(SokobanGame *game) {
+  SDL_assert(game != 0);
+
+  if (!move_log_redo(&game->log, &game->level, &game->state))
+    return false;
+  const uint8_t step = LURD_STEPS[(uint8_t)game->log.moves[game->log.len - 1]];
+  if (step > 4)
+    sokoban_check_dead_end(game, (step - 1) % 4);
+  return true;
+}
+
+uint32_t sokoban_width(const SokobanGame *game) {
+  SDL_assert(game != 0);
+  return game->level.width;
+}
+
+uint32_t sokoban_height(const SokobanGame *game) {
+  SDL_assert(game != 0);
+  return game->level.height;
+}
+
+uint8_t sokoban_cell(const SokobanGame *game, uint32_t x, uint32_t y) {
+  SDL_assert(game != 0);
+  SDL_assert(x < game->level.width);
+  SDL_assert(y < game->level.height);
+
+  const uint32_t cell_i = y * game->level.width + x;
+  Entity cell = game->level.statics[cell_i];
+  if (bitmap_contains(game->state.crates, cell_i))
+    bitset_add(&cell, ENTITY_CRATE);
+  if (cell_i == game->state.character_cell_i)
+    bitset_add(&cell, ENTITY_CHARACTER);
+  return cell;
+}
+
+void sokoban_character(const SokobanGame *game, uint32_t *x, uint32_t *y) {
+  SDL_assert(game != 0);
+  SDL_assert(x != 0);
+  SDL_assert(y != 0);
+
+  *x = game->state.character_cell_i % game->level.width;
+  *y = game->state.character_cell_i / game->level.width;
+}
+
+bool sokoban_is_won(const SokobanGame *game) {
+  SDL_assert(game != 0);
+  return game_is_won(&game->level, &game->state);
+}
+
+bool sokoban_is_dead_end(const SokobanGame *game) {
+  SDL_assert(game != 0);
+  return game->dead_end_len != 0;
+}
+
+const char *sokoban_moves(const SokobanGame *game, uint32_t *moves_len) {
+  SDL_assert(game != 0);
+  SDL_assert(moves_len != 0);
+
+  *moves_len = game->log.len;
+  return game->log.moves;
+}
+
+SokobanBatch *sokoban_batch_new(const SokobanGame *game, uint32_t count) {
+  SDL_assert(game != 0);
+
+  SokobanBatch *const batch = malloc(sizeof(SokobanBatch));
+  SDL_assert(batch != 0);
+  batch_init(&game->level, count, &batch->batch);
+  return batch;
+}
+
+void sokoban_batch_free(SokobanBatch *batch) {
+  if (!batch)
+    return;
+
+  batch_destroy(&batch->batch);
+  free(batch);
+}
+
+void sokoban_batch_reset(SokobanBatch *batch) {
+  SDL_assert(batch != 0);
+
+  for (uint32_t g = 0; g < batch->batch.count; g++)
+    batch_reset_game(&batch->batch, g);
+}
+
+void sokoban_batch_step(SokobanBatch *batch, const uint8_t *actions,
+                        float *rewards, uint8_t *dones) {
+  SDL_assert(batch != 0);
+  batch_step(&batch->batch, actions, rewards, dones);
+}
+
+static ObserveStrides sokoban_strides(const SokobanStrides *strides) {
+  SDL_assert(strides != 0);
+  return (ObserveStrides){.game = strides->game,
+                          .plane = strides->plane,
+                          .row = strides->row,
+                          .cell = strides->cell};
+}
+
+void sokoban_observe(SokobanGame *game, SokobanObservation observation,
+                     uint8_t *out, const SokobanStrides *strides) {
+  SDL_assert(game != 0);
+
+  const ObserveStrides observe_strides = sokoban_strides(strides);
+  level_compose(&game->level, &game->state, game->cells);
+  observe_cells(&game->level, game->cells, (ObserveFormat)observation, out,
+                &observe_strides);
+}
+
+void sokoban_batch_observe(SokobanBatch *batch,
+                           SokobanObservation observation, uint8_t *out,
+                           const SokobanStrides *strides) {
+  SDL_assert(batch != 0);
+
+  const ObserveStrides observe_strides = sokoban_strides(strides);
+  observe_batch(&batch->batch, (ObserveFormat)observation, out,
+                &observe_strides);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// The game without a window, for programs to embed: load a level, play moves
+// on it and ask about it. Build `libsokoban.a` with `make libsokoban.a`, and
+// link against it: no SDL needed.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct SokobanGame SokobanGame;
+typedef struct SokobanBatch SokobanBatch;
+
+typedef enum {
+  SOKOBAN_UP,
+  SOKOBAN_RIGHT,
+  SOKOBAN_DOWN,
+  SOKOBAN_LEFT,
+} SokobanDirection;
+
+// Outcome of a step.
+typedef enum {
+  SOKOBAN_BLOCKED,
+  SOKOBAN_WALKED,
+  SOKOBAN_PUSHED,
+} SokobanStep;
+
+// Bits of a cell.
+enum {
+  SOKOBAN_WALL = 1 << 0,
+  SOKOBAN_OBJECTIVE = 1 << 1,
+  SOKOBAN_CRATE = 1 << 2,
+  SOKOBAN_CHARACTER = 1 << 4,
+};
+
+// The level in the `.soko` file at `path`, at its start. Returns 0, with the
+// reason on stderr, if it cannot be read.
+SokobanGame *sokoban_open(const char *path);
+void sokoban_close(SokobanGame *game);
+
+// Back to the start. The moves can still be redone.
+void sokoban_restart(SokobanGame *game);
+SokobanStep sokoban_step(SokobanGame *game, SokobanDirection dir);
+// Steps for each LURD letter of `lurd`, uppercase for a push. Returns how many
+// were played as written: it stops at the first one that is not.
+uint32_t sokoban_play(SokobanGame *game, const char *lurd);
+// Returns false if there is no move to undo, or to redo.
+bool sokoban_undo(SokobanGame *game);
+bool sokoban_redo(SokobanGame *game);
+
+uint32_t sokoban_width(const SokobanGame *game);
+uint32_t sokoban_height(const SokobanGame *game);
+// Bits of the cell at `x`, `y`.
+uint8_t sokoban_cell(const SokobanGame *game, uint32_t x, uint32_t y);
+void sokoban_character(const SokobanGame *game, uint32_t *x, uint32_t *y);
+bool sokoban_is_won(const SokobanGame *game);
+// Whether a crate was pushed where the level cannot be solved any more.
+bool sokoban_is_dead_end(const SokobanGame *game);
+// The moves played, as `moves_len` LURD letters. Not nul terminated.
+const char *sokoban_moves(const SokobanGame *game, uint32_t *moves_len);
+
+// `count` games of the level of `game`, each at its start, played together.
+// `game` must outlive the batch.
+SokobanBatch *sokoban_batch_new(const SokobanGame *game, uint32_t count);
+void sokoban_batch_free(SokobanBatch *batch);
+// Every game back to its start.
+void sokoban_batch_reset(SokobanBatch *batch);
+// One step of every game, game `i` playing `actions[i]`, a `SokobanDirection`.
+// Its reward goes to `rewards[i]`: -0.1 a step, +1 for a crate pushed onto an
+// objective, -1 off one, +10 on winning. `dones[i]` is 1 if it was won or
+// pushed a crate onto a dead square, and it started over. Other dead ends,
+// such as crates frozen against each other, do not end a game.
+void sokoban_batch_step(SokobanBatch *batch, const uint8_t *actions,
+                        float *rewards, uint8_t *dones);
+
+// What an observation holds: the bits of every cell, one byte each, or planes
+// of one byte per cell, 1 where the cell has a wall, an objective, a crate and
+// the character, in that order.
+typedef enum {
+  SOKOBAN_GRID,
+  SOKOBAN_PLANES,
+} SokobanObservation;
+
+// Layout of the caller's buffer: bytes from one game, plane, row and cell to
+// the next. Each cell of a row next to the previous (`cell` of 1) is fastest.
+typedef struct {
+  size_t game, plane, row, cell;
+} SokobanStrides;
+
+// The observation of `game` into `out`, laid out as `strides` says (`game`
+// unused).
+void sokoban_observe(SokobanGame *game, SokobanObservation observation,
+                     uint8_t *out, const SokobanStrides *strides);
+// The observation of every game of `batch`, game `i` at
+// `out + i * strides->game`.
+void sokoban_batch_observe(SokobanBatch *batch,
+                           SokobanObservation observation, uint8_t *out,
+                           const SokobanStrides *strides);
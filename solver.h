@@ -0,0 +1,145 @@
+#pragma once
+
+// Headless solver. Prints the solution in LURD notation (lowercase: walk,
+// uppercase: push).
+//
+// The searches share the same node storage, with states packed as in
+// `packed.h`:
+// - `SEARCH_MOVES`: every step of the character is a node. Move-optimal, but
+//   the state space is multiplied by the size of the open floor.
+// - `SEARCH_PUSHES`: a node is a set of crates plus the region the character
+//   can walk in, identified by its smallest cell. Successors are the pushes
+//   available from that region, found with one flood fill. Push-optimal. The
+//   walks between pushes are filled in when backtracking.
+// - `SEARCH_ASTAR`: the same push-level nodes, expanded best first on pushes
+//   so far plus the matching lower bound of `heuristic.h`. Push-optimal.
+// - `SEARCH_GREEDY`: the same, on the bound alone. Not optimal, but often
+//   the fastest to find a solution.
+// - `SEARCH_IDASTAR`: the same bound, iteratively deepened depth first, in a
+//   fixed amount of memory. See `idastar.h`.
+// - `SEARCH_BIDIRECTIONAL`: push-level, forward from the initial position and
+//   backward from the solved ones until they meet. See `bidirectional.h`.
+// - `SEARCH_EXTERNAL`: push-level breadth-first, with the visited states on
+//   disk instead of in memory. See `external.h`.
+//
+// With `macros`, the push-level searches go through tunnels and into goal
+// rooms in one step (see `macros.h`). Fewer nodes, but no optimality.
+
+#include "bidirectional.h"
+#include "external.h"
+#include "idastar.h"
+#include "parallel.h"
+#include "search.h"
+
+typedef enum {
+  SEARCH_MOVES,
+  SEARCH_PUSHES,
+  SEARCH_ASTAR,
+  SEARCH_GREEDY,
+  SEARCH_IDASTAR,
+  SEARCH_BIDIRECTIONAL,
+  SEARCH_EXTERNAL,
+} SearchMode;
+
+// As given to `--search`.
+static const char *const SEARCH_NAMES[] = {
+    [SEARCH_MOVES] = "moves",       [SEARCH_PUSHES] = "pushes",
+    [SEARCH_ASTAR] = "astar",       [SEARCH_GREEDY] = "greedy",
+    [SEARCH_IDASTAR] = "idastar",   [SEARCH_BIDIRECTIONAL] = "bidir",
+    [SEARCH_EXTERNAL] = "external",
+};
+
+typedef struct {
+  SearchMode mode;
+  uint32_t threads; // Only `SEARCH_PUSHES` runs on more than one.
+  // Visited states table, or sort buffer of `SEARCH_EXTERNAL`.
+  size_t ram_bytes;
+  const char *tmp_dir; // For `SEARCH_EXTERNAL`.
+  bool macros;
+  // Set from another thread to stop the search. May be 0. Checked once per
+  // node, or once per layer by the parallel search.
+  const bool *cancel;
+} SolverOptions;
+
+static void solve(const Entity *map, uint32_t width, uint32_t height,
+                  const SolverOptions *options, SolverStats *stats) {
+  SDL_assert(map != 0);
+  SDL_assert(options != 0);
+  SDL_assert(stats != 0);
+
+  if (options->threads > 1 && options->mode == SEARCH_PUSHES) {
+    solve_parallel(map, width, height, options->threads, options->ram_bytes,
+                   options->macros, options->cancel, stats);
+    return;
+  }
+
+  *stats = (SolverStats){0};
+  const double start = now_s();
+
+  Solver solver;
+  SolverNode root;
+  // The external search keeps its visited states on disk.
+  const size_t tt_bytes =
+      options->mode == SEARCH_EXTERNAL ? 0 : options->ram_bytes;
+  if (!solver_init(&solver, map, width, height, tt_bytes, options->macros,
+                   &root))
+    return;
+  solver.cancel = options->cancel;
+
+  switch (options->mode) {
+  case SEARCH_MOVES:
+    solve_moves(&solver, &root, stats);
+    break;
+  case SEARCH_PUSHES:
+    solve_pushes(&solver, &root, stats);
+    break;
+  case SEARCH_ASTAR:
+    solve_astar(&solver, &root, false, stats);
+    break;
+  case SEARCH_GREEDY:
+    solve_astar(&solver, &root, true, stats);
+    break;
+  case SEARCH_IDASTAR:
+    solve_idastar(&solver, &root, stats);
+    break;
+  case SEARCH_BIDIRECTIONAL:
+    solve_bidirectional(&solver, &root, stats);
+    break;
+  case SEARCH_EXTERNAL:
+    solve_external(&solver, &root, options->tmp_dir, options->ram_bytes,
+                   stats);
+    break;
+  }
+  if (stats->solution)
+    solver_count_moves(stats->solution, stats);
+
+  stats->elapsed_s = now_s() - start;
+  stats->peak_memory_kib = peak_memory_kib();
+  solver_destroy(&solver);
+}
+
+static void print_solver_stats(const SolverStats *stats) {
+  SDL_assert(stats != 0);
+
+  if (stats->solution)
+    fprintf(stderr, "Solved: %u moves, %u pushes\n", stats->moves,
+            stats->pushes);
+  else if (stats->limit_reached)
+    fprintf(stderr, "Gave up: node limit reached\n");
+  else
+    fprintf(stderr, "No solution\n");
+
+  fprintf(stderr,
+          "Nodes expanded: %llu\nTime: %.3f s\nNodes/s: %.0f\n"
+          "Peak memory: %ld KiB\n",
+          (unsigned long long)stats->nodes_expanded, stats->elapsed_s,
+          stats->elapsed_s > 0 ? stats->nodes_expanded / stats->elapsed_s : 0,
+          stats->peak_memory_kib);
+  if (stats->visited.cap)
+    fprintf(stderr,
+            "Visited set: %llu states, load factor %.3f, probes %.2f mean, "
+            "%u max\n",
+            (unsigned long long)stats->visited.len,
+            stats->visited.load_factor, stats->visited.mean_probes,
+            stats->visited.max_probes);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Undo and redo for the game. Each move played is logged as one byte, its
+// LURD letter: the direction, uppercase if a crate was pushed. That is enough
+// to take it back in place (see `game_go_back()`), without any copy of the
+// level. The log is also the solution so far.
+
+#include "level.h"
+
+typedef struct {
+  char *moves;
+  uint32_t len; // Moves played.
+  uint32_t end; // Moves logged, past `len` those undone.
+  uint32_t cap;
+} MoveLog;
+
+// `game_go()`, logged. Forgets the moves undone.
+static GoResult move_log_go(MoveLog *log, const Level *level,
+                            GameState *state, Direction dir) {
+  SDL_assert(log != 0);
+
+  const GoResult result = game_go(level, state, dir);
+  if (result == GO_BLOCKED)
+    return result;
+
+  if (log->len == log->cap) {
+    log->cap = log->cap ? log->cap * 2 : 256;
+    log->moves = realloc(log->moves, log->cap);
+    SDL_assert(log->moves != 0);
+  }
+  log->moves[log->len++] =
+      result == GO_PUSHED ? LURD_PUSH[dir] : LURD_WALK[dir];
+  log->end = log->len;
+  return result;
+}
+
+// Take back the last move played. Returns false if there is none.
+static bool move_log_undo(MoveLog *log, const Level *level, GameState *state) {
+  SDL_assert(log != 0);
+
+  if (log->len == 0)
+    return false;
+
+  const uint8_t step = LURD_STEPS[(uint8_t)log->moves[--log->len]];
+  game_go_back(level, state, (step - 1) % 4, step > 4);
+  return true;
+}
+
+// Play again the last move undone. Returns false if there is none.
+static bool move_log_redo(MoveLog *log, const Level *level, GameState *state) {
+  SDL_assert(log != 0);
+
+  if (log->len == log->end)
+    return false;
+
+  const uint8_t step = LURD_STEPS[(uint8_t)log->moves[log->len++]];
+  const GoResult result = game_go(level, state, (step - 1) % 4);
+  SDL_assert(result == (step > 4 ? GO_PUSHED : GO_WALKED));
+  (void)result;
+  return true;
+}
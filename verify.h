@@ -0,0 +1,433 @@
+#pragma once
+
+// Bulk checks of solutions: `sokoban --verify solutions.txt levels.sok`.
+//
+// Each line of the solutions is the id of a level, then its LURD moves. The
+// file is mapped in memory and split between every core at line ends; each
+// thread replays its lines with `apply_moves()` into its own part of the
+// report, and the parts are printed in order. A report line is the line
+// number, the level id, `pass` or `fail`, and the moves and pushes played, then
+// why it failed: `unknown level`, `move N` (the first one that is not a LURD
+// letter or does not walk or push as its case says) or `not solved`.
+//
+// In the levels, a level is a block of lines of cells. Its id is the first
+// other line since the previous level, without a leading `;`, or its rank in
+// the file, from 1, if there is none. Ids end at the first space in the
+// solutions, so only names without one can be checked.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "level.h"
+
+typedef struct {
+  char *id;
+  Level level;
+  Entity *start; // Both layers at the start, `level.size` cells.
+} VerifyLevel;
+
+typedef struct {
+  VerifyLevel *levels; // Sorted by id.
+  uint32_t len;
+  uint32_t max_size;
+} VerifyLevels;
+
+typedef struct {
+  const VerifyLevels *levels;
+  pthread_t thread;
+  const char *begin, *end; // Whole lines.
+  uint32_t first_line;     // Number of the line at `begin`, from 1.
+  uint32_t lines;          // Lines from `begin` to `end`.
+  uint32_t passed, failed;
+  char *report;
+  size_t report_len, report_cap;
+} VerifyWorker;
+
+// The file at `path` mapped in memory, read only. `*data` is 0 if it is empty.
+static bool verify_map_file(const char *path, const char **data,
+                            size_t *len) {
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+
+  *len = (size_t)st.st_size;
+  *data = 0;
+  if (*len) {
+    void *const mapped = mmap(0, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      fprintf(stderr, "Failed to map %s\n", path);
+      close(fd);
+      return false;
+    }
+    posix_madvise(mapped, *len, POSIX_MADV_SEQUENTIAL);
+    *data = mapped;
+  }
+  close(fd);
+  return true;
+}
+
+// The line at `line`, to `end` at most, without its line end.
+static const char *verify_line_end(const char *line, const char *end) {
+  const char *const newline = memchr(line, '\n', (size_t)(end - line));
+  return newline ? newline : end;
+}
+
+// Whether the line is cells of a level: only cell characters, and a wall.
+static bool verify_is_cells(const char *line, const char *line_end) {
+  bool wall = false;
+  for (const char *c = line; c < line_end; c++) {
+    Entity cell;
+    if (*c == '\r')
+      continue;
+    if (!entity_from_char(*c, &cell))
+      return false;
+    wall |= *c == '#';
+  }
+  return wall;
+}
+
+static int verify_level_cmp(const void *a, const void *b) {
+  return strcmp(((const VerifyLevel *)a)->id, ((const VerifyLevel *)b)->id);
+}
+
+// The level of the `rows` lines from `text`, up to `end`. Its id is `name`,
+// `name_len` bytes, or `rank` without a name. Returns false, with the reason
+// on stderr, if it has not exactly one character or is not walled in.
+static bool verify_add_level(VerifyLevels *levels, const char *text,
+                             const char *end, uint32_t rows, const char *name,
+                             size_t name_len, uint32_t rank) {
+  char *const id = malloc(name ? name_len + 1 : 16);
+  SDL_assert(id != 0);
+  if (name) {
+    __builtin_memcpy(id, name, name_len);
+    id[name_len] = 0;
+  } else {
+    snprintf(id, 16, "%u", rank);
+  }
+
+  uint32_t width = 0;
+  const char *line = text;
+  for (uint32_t y = 0; y < rows; y++) {
+    const char *const line_end = verify_line_end(line, end);
+    uint32_t x = 0;
+    for (const char *c = line; c < line_end; c++)
+      x += *c != '\r';
+    if (x > width)
+      width = x;
+    line = line_end + 1;
+  }
+
+  Entity *const cells = malloc((size_t)width * rows);
+  SDL_assert(cells != 0);
+  __builtin_memset(cells, ENTITY_WALL, (size_t)width * rows);
+  uint32_t characters_count = 0;
+  line = text;
+  for (uint32_t y = 0; y < rows; y++) {
+    const char *const line_end = verify_line_end(line, end);
+    uint32_t x = 0;
+    for (const char *c = line; c < line_end; c++) {
+      if (*c == '\r')
+        continue;
+      Entity *const cell = &cells[y * width + x++];
+      entity_from_char(*c, cell);
+      characters_count += bitset_contains(*cell, ENTITY_CHARACTER);
+    }
+    line = line_end + 1;
+  }
+  if (characters_count != 1) {
+    fprintf(stderr, "Level %s: expected exactly one character, got %u\n", id,
+            characters_count);
+    free(cells);
+    free(id);
+    return false;
+  }
+  uint32_t open_i = 0;
+  if (!map_is_enclosed(cells, width, rows, &open_i, 0)) {
+    fprintf(stderr, "Level %s:%u:%u: not walled in\n", id,
+            open_i / width + 1, open_i % width + 1);
+    free(cells);
+    free(id);
+    return false;
+  }
+
+  levels->levels =
+      realloc(levels->levels, (levels->len + 1) * sizeof(VerifyLevel));
+  SDL_assert(levels->levels != 0);
+  VerifyLevel *const level = &levels->levels[levels->len++];
+  level->id = id;
+  level_init(cells, width, rows, &level->level);
+  level->start = cells;
+  if (level->level.size > levels->max_size)
+    levels->max_size = level->level.size;
+  return true;
+}
+
+// The levels of the collection `text`, `len` bytes. Returns false if a level
+// is not one, or two have the same id.
+static bool verify_read_levels(const char *text, size_t len,
+                               VerifyLevels *levels) {
+  *levels = (VerifyLevels){0};
+  const char *const end = text + len;
+  const char *name = 0, *rows_begin = 0;
+  size_t name_len = 0;
+  uint32_t rows = 0, rank = 0;
+  bool ok = true;
+  const char *line = text;
+  while (ok) {
+    const char *const line_end = verify_line_end(line, end);
+    const bool last = line_end == end;
+    const bool cells = line < line_end && verify_is_cells(line, line_end);
+    if (cells && rows++ == 0)
+      rows_begin = line;
+
+    // The level ends with its last line of cells.
+    if (rows && (!cells || last)) {
+      ok = verify_add_level(levels, rows_begin, end, rows, name, name_len,
+                            ++rank);
+      rows = 0;
+      name = 0;
+    }
+
+    if (!cells && !name) {
+      const char *begin = line, *stop = line_end;
+      if (begin < stop && *begin == ';')
+        begin++;
+      while (begin < stop && (*begin == ' ' || *begin == '\t'))
+        begin++;
+      while (stop > begin && (stop[-1] == ' ' || stop[-1] == '\t' ||
+                              stop[-1] == '\r'))
+        stop--;
+      if (begin < stop) {
+        name = begin;
+        name_len = (size_t)(stop - begin);
+      }
+    }
+    if (last)
+      break;
+    line = line_end + 1;
+  }
+  if (!ok)
+    return false;
+
+  qsort(levels->levels, levels->len, sizeof(VerifyLevel), verify_level_cmp);
+  for (uint32_t i = 1; i < levels->len; i++) {
+    if (strcmp(levels->levels[i - 1].id, levels->levels[i].id) == 0) {
+      fprintf(stderr, "Two levels named %s\n", levels->levels[i].id);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void verify_levels_destroy(VerifyLevels *levels) {
+  for (uint32_t i = 0; i < levels->len; i++) {
+    free(levels->levels[i].id);
+    free(levels->levels[i].start);
+    level_destroy(&levels->levels[i].level);
+  }
+  free(levels->levels);
+}
+
+static const VerifyLevel *verify_find_level(const VerifyLevels *levels,
+                                            const char *id, size_t id_len) {
+  uint32_t low = 0, high = levels->len;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    const char *const mid_id = levels->levels[mid].id;
+    int cmp = strncmp(mid_id, id, id_len);
+    if (cmp == 0)
+      cmp = mid_id[id_len] != 0;
+    if (cmp == 0)
+      return &levels->levels[mid];
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return 0;
+}
+
+static void verify_report(VerifyWorker *worker, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void verify_report(VerifyWorker *worker, const char *format, ...) {
+  while (true) {
+    va_list args;
+    va_start(args, format);
+    const size_t room = worker->report_cap - worker->report_len;
+    const int len = vsnprintf(worker->report + worker->report_len, room,
+                              format, args);
+    va_end(args);
+    SDL_assert(len >= 0);
+    if ((size_t)len < room) {
+      worker->report_len += (size_t)len;
+      return;
+    }
+    worker->report_cap = worker->report_cap ? worker->report_cap * 2 : 4096;
+    worker->report = realloc(worker->report, worker->report_cap);
+    SDL_assert(worker->report != 0);
+  }
+}
+
+static void *verify_count_lines(void *arg) {
+  VerifyWorker *const worker = arg;
+  for (const char *line = worker->begin; line < worker->end;
+       line = verify_line_end(line, worker->end) + 1)
+    worker->lines++;
+  return 0;
+}
+
+static void *verify_run(void *arg) {
+  VerifyWorker *const worker = arg;
+  Entity *const map = malloc(worker->levels->max_size);
+  SDL_assert(map != 0);
+
+  uint32_t line_number = worker->first_line;
+  for (const char *line = worker->begin; line < worker->end;
+       line_number++) {
+    const char *line_end = verify_line_end(line, worker->end);
+    const char *const next_line = line_end + 1;
+    while (line_end > line && (line_end[-1] == '\r' || line_end[-1] == ' ' ||
+                               line_end[-1] == '\t'))
+      line_end--;
+    if (line == line_end) {
+      line = next_line;
+      continue;
+    }
+
+    const char *id_end = line;
+    while (id_end < line_end && *id_end != ' ' && *id_end != '\t')
+      id_end++;
+    const char *moves = id_end;
+    while (moves < line_end && (*moves == ' ' || *moves == '\t'))
+      moves++;
+    const size_t moves_len = (size_t)(line_end - moves);
+    const int id_len = (int)(id_end - line);
+
+    const VerifyLevel *const level =
+        verify_find_level(worker->levels, line, (size_t)id_len);
+    if (!level) {
+      verify_report(worker, "%u %.*s fail 0 0 unknown level\n", line_number,
+                    id_len, line);
+      worker->failed++;
+      line = next_line;
+      continue;
+    }
+
+    __builtin_memcpy(map, level->start, level->level.size);
+    uint32_t character_cell_i = level->level.start.character_cell_i;
+    const size_t played = apply_moves(map, level->level.neighbours,
+                                      &character_cell_i, moves, moves_len);
+    uint32_t pushes = 0;
+    for (size_t i = 0; i < played; i++)
+      pushes += moves[i] >= 'A' && moves[i] <= 'Z';
+
+    bool won = played == moves_len;
+    for (uint32_t w = 0; w < level->level.words && won; w++) {
+      for (uint64_t bits = level->level.objectives[w]; bits && won;
+           bits &= bits - 1)
+        won = bitset_contains(map[w * 64 + __builtin_ctzll(bits)],
+                              ENTITY_CRATE);
+    }
+
+    if (won) {
+      verify_report(worker, "%u %.*s pass %zu %u\n", line_number, id_len, line,
+                    played, pushes);
+      worker->passed++;
+    } else if (played < moves_len) {
+      verify_report(worker, "%u %.*s fail %zu %u move %zu\n", line_number,
+                    id_len, line, played, pushes, played + 1);
+      worker->failed++;
+    } else {
+      verify_report(worker, "%u %.*s fail %zu %u not solved\n", line_number,
+                    id_len, line, played, pushes);
+      worker->failed++;
+    }
+    line = next_line;
+  }
+  free(map);
+  return 0;
+}
+
+// Runs `run` on every worker, one thread each.
+static void verify_run_workers(VerifyWorker *workers, uint32_t workers_len,
+                               void *(*run)(void *)) {
+  for (uint32_t t = 0; t < workers_len; t++)
+    pthread_create(&workers[t].thread, 0, run, &workers[t]);
+  for (uint32_t t = 0; t < workers_len; t++)
+    pthread_join(workers[t].thread, 0);
+}
+
+// Checks the solutions of `solutions_path` against the levels of
+// `levels_path`, reports to stdout, and sums up to stderr. Returns false if
+// the files cannot be read, or a solution fails.
+static bool verify(const char *solutions_path, const char *levels_path) {
+  const char *levels_text = 0, *solutions = 0;
+  size_t levels_len = 0, solutions_len = 0;
+  if (!verify_map_file(levels_path, &levels_text, &levels_len))
+    return false;
+  VerifyLevels levels;
+  const bool levels_ok = verify_read_levels(levels_text, levels_len, &levels);
+  if (levels_text)
+    munmap((void *)levels_text, levels_len);
+  if (!levels_ok || !verify_map_file(solutions_path, &solutions,
+                                     &solutions_len)) {
+    verify_levels_destroy(&levels);
+    return false;
+  }
+
+  const double start = now_s();
+  const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  const uint32_t workers_len = cores > 0 ? (uint32_t)cores : 1;
+  VerifyWorker *const workers = calloc(workers_len, sizeof(VerifyWorker));
+  SDL_assert(workers != 0);
+  // Even parts, each moved on to the start of a line.
+  const char *const end = solutions + solutions_len;
+  const char *begin = solutions;
+  for (uint32_t t = 0; t < workers_len; t++) {
+    const char *split = t + 1 == workers_len
+                            ? end
+                            : solutions + solutions_len / workers_len * (t + 1);
+    if (split < begin)
+      split = begin;
+    if (split > solutions && split < end && split[-1] != '\n') {
+      split = verify_line_end(split, end);
+      split += split < end;
+    }
+    workers[t] = (VerifyWorker){
+        .levels = &levels, .begin = begin, .end = split};
+    begin = split;
+  }
+  verify_run_workers(workers, workers_len, verify_count_lines);
+  workers[0].first_line = 1;
+  for (uint32_t t = 1; t < workers_len; t++)
+    workers[t].first_line = workers[t - 1].first_line + workers[t - 1].lines;
+  verify_run_workers(workers, workers_len, verify_run);
+
+  uint32_t passed = 0, failed = 0;
+  for (uint32_t t = 0; t < workers_len; t++) {
+    fwrite(workers[t].report, 1, workers[t].report_len, stdout);
+    passed += workers[t].passed;
+    failed += workers[t].failed;
+    free(workers[t].report);
+  }
+  const double elapsed_s = now_s() - start;
+  fprintf(stderr, "%u solutions: %u passed, %u failed, %.3f s, %.0f/s\n",
+          passed + failed, passed, failed, elapsed_s,
+          elapsed_s > 0 ? (passed + failed) / elapsed_s : 0);
+
+  free(workers);
+  if (solutions)
+    munmap((void *)solutions, solutions_len);
+  verify_levels_destroy(&levels);
+  return failed == 0;
+}
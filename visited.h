@@ -0,0 +1,166 @@
+#pragma once
+
+// Set of visited states shared between threads, without locks.
+//
+// Keys are exact 128 bit states rather than hashes, so that two states never
+// collide. Open addressing with linear probing over a fixed amount of memory:
+// a slot goes from empty to its key with a single 16 byte compare-and-swap and
+// never changes afterwards, so reading a slot needs no lock either. Inserting
+// into a table that is locally full fails instead of evicting anything.
+//
+// Without a 16 byte compare-and-swap (x86-64 needs `-mcx16`), slots are
+// claimed under a spinlock instead, and reading them still needs none.
+
+#include <stdlib.h>
+
+#include "rules.h"
+
+#define VISITED_MAX_PROBES 256
+
+#ifndef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+// By slot, shared by every set.
+#define VISITED_LOCKS 64
+static bool visited_locks[VISITED_LOCKS];
+#endif
+
+// The top bit of `hi` is always set so that 0 can mean empty.
+typedef struct __attribute__((aligned(16))) {
+  uint64_t lo, hi;
+} VisitedKey;
+
+typedef enum {
+  VISITED_INSERTED,
+  VISITED_PRESENT,
+  VISITED_FULL,
+} VisitedResult;
+
+typedef struct {
+  VisitedKey *entries;
+  uint64_t mask;
+} VisitedSet;
+
+typedef struct {
+  uint64_t len, cap;
+  double load_factor;
+  double mean_probes; // Slots looked at to find a key, 1 if in its home slot.
+  uint32_t max_probes;
+} VisitedStats;
+
+// `hi` may use at most 63 bits.
+static VisitedKey visited_key(uint64_t lo, uint64_t hi) {
+  SDL_assert(hi >> 63 == 0);
+  return (VisitedKey){.lo = lo, .hi = hi | (uint64_t)1 << 63};
+}
+
+// MurmurHash3 finalizer.
+static uint64_t visited_mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53;
+  h ^= h >> 33;
+  return h;
+}
+
+// Keys are packed states, far from random: mix both halves.
+static uint64_t visited_home(VisitedKey key) {
+  return visited_mix(visited_mix(key.hi) ^ key.lo);
+}
+
+static bool visited_init(VisitedSet *set, size_t bytes) {
+  SDL_assert(set != 0);
+
+  uint64_t cap = 1;
+  while (cap * 2 * sizeof(VisitedKey) <= bytes)
+    cap *= 2;
+
+  set->entries = calloc(cap, sizeof(VisitedKey));
+  set->mask = cap - 1;
+  return set->entries != 0;
+}
+
+static void visited_destroy(VisitedSet *set) {
+  SDL_assert(set != 0);
+
+  free(set->entries);
+  *set = (VisitedSet){0};
+}
+
+// Write `desired` into the slot `entry` if it is empty, and return what it held
+// before, 0 if empty.
+static unsigned __int128 visited_claim(VisitedKey *entry, uint64_t slot,
+                                       unsigned __int128 desired) {
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+  (void)slot;
+  return __sync_val_compare_and_swap((unsigned __int128 *)entry, 0, desired);
+#else
+  bool *const lock = &visited_locks[slot % VISITED_LOCKS];
+  while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE))
+    ;
+  const VisitedKey previous = {
+      .lo = __atomic_load_n(&entry->lo, __ATOMIC_RELAXED),
+      .hi = __atomic_load_n(&entry->hi, __ATOMIC_RELAXED)};
+  if (previous.hi == 0) {
+    VisitedKey key;
+    __builtin_memcpy(&key, &desired, sizeof(key));
+    // The high half last: once readers see it, the low half is there.
+    __atomic_store_n(&entry->lo, key.lo, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->hi, key.hi, __ATOMIC_RELEASE);
+  }
+  __atomic_clear(lock, __ATOMIC_RELEASE);
+
+  unsigned __int128 held;
+  __builtin_memcpy(&held, &previous, sizeof(held));
+  return held;
+#endif
+}
+
+// Safe to call from any number of threads at once.
+static VisitedResult visited_insert(VisitedSet *set, VisitedKey key) {
+  SDL_assert(set != 0);
+
+  unsigned __int128 desired;
+  __builtin_memcpy(&desired, &key, sizeof(desired));
+
+  uint64_t slot = visited_home(key) & set->mask;
+  for (uint32_t probe = 0; probe < VISITED_MAX_PROBES; probe++) {
+    VisitedKey *const entry = &set->entries[slot];
+    // A taken slot never has a 0 high half, and never changes again.
+    const uint64_t hi = __atomic_load_n(&entry->hi, __ATOMIC_ACQUIRE);
+    if (hi == 0) {
+      const unsigned __int128 previous = visited_claim(entry, slot, desired);
+      if (previous == 0)
+        return VISITED_INSERTED;
+      if (previous == desired)
+        return VISITED_PRESENT;
+    } else if (hi == key.hi &&
+               __atomic_load_n(&entry->lo, __ATOMIC_RELAXED) == key.lo) {
+      return VISITED_PRESENT;
+    }
+    slot = (slot + 1) & set->mask;
+  }
+  return VISITED_FULL;
+}
+
+// Walks the whole table: only call while nobody inserts.
+static VisitedStats visited_stats(const VisitedSet *set) {
+  SDL_assert(set != 0);
+
+  VisitedStats stats = {.cap = set->mask + 1};
+  uint64_t probes = 0;
+  for (uint64_t slot = 0; slot <= set->mask; slot++) {
+    const VisitedKey key = set->entries[slot];
+    if (key.hi == 0)
+      continue;
+
+    const uint32_t key_probes =
+        ((slot - visited_home(key)) & set->mask) + 1;
+    stats.len++;
+    probes += key_probes;
+    if (key_probes > stats.max_probes)
+      stats.max_probes = key_probes;
+  }
+  stats.load_factor = (double)stats.len / stats.cap;
+  stats.mean_probes = stats.len ? (double)probes / stats.len : 0;
+  return stats;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+// Zobrist hashing of search states and a fixed size transposition table.
+//
+// A state is the set of crates plus the character. The hash is the xor of one
+// random key per crate cell and one per character cell, so that a step or a
+// push updates it in O(1) instead of rehashing the whole map. Push-level
+// searches hash the character with the normalized (minimum) cell of its
+// reachable region instead of its exact cell.
+
+#include <stdlib.h>
+
+#include "rules.h"
+
+typedef struct {
+  uint64_t crate[MAP_MAX_SIZE];
+  uint64_t character[MAP_MAX_SIZE];
+} ZobristKeys;
+
+static ZobristKeys zobrist_keys;
+
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Fixed seed: hashes are stable across runs, which helps when comparing
+// statistics.
+static void zobrist_init(void) {
+  uint64_t state = 0x50c0ba4ULL;
+  for (uint16_t i = 0; i < MAP_MAX_SIZE; i++) {
+    zobrist_keys.crate[i] = splitmix64(&state);
+    zobrist_keys.character[i] = splitmix64(&state);
+  }
+}
+
+// Hash of `map`, of `size` cells.
+static uint64_t zobrist_hash(const Entity *map, uint32_t size,
+                             uint32_t character_cell_i) {
+  SDL_assert(map != 0);
+  SDL_assert(size <= MAP_MAX_SIZE);
+
+  uint64_t h = zobrist_keys.character[character_cell_i];
+  for (uint32_t i = 0; i < size; i++) {
+    if (bitset_contains(map[i], ENTITY_CRATE))
+      h ^= zobrist_keys.crate[i];
+  }
+  return h;
+}
+
+static uint64_t zobrist_move_character(uint64_t h, uint32_t from,
+                                       uint32_t to) {
+  return h ^ zobrist_keys.character[from] ^ zobrist_keys.character[to];
+}
+
+static uint64_t zobrist_move_crate(uint64_t h, uint32_t from, uint32_t to) {
+  return h ^ zobrist_keys.crate[from] ^ zobrist_keys.crate[to];
+}
+
+// Update `h` after `go_by()` moved the character from `from`, `offset` away.
+static uint64_t zobrist_go(uint64_t h, GoResult res, int32_t offset,
+                           uint32_t from) {
+  if (res == GO_BLOCKED)
+    return h;
+
+  const uint32_t to = from + offset;
+  h = zobrist_move_character(h, from, to);
+  if (res == GO_PUSHED)
+    h = zobrist_move_crate(h, to, to + offset);
+  return h;
+}
+
+// Open addressing with linear probing over a fixed amount of memory. Keys are
+// full 64 bit hashes and are trusted to be unique, as usual for transposition
+// tables. When the probe limit is hit, the home slot is overwritten: the search
+// may then expand a state twice, but never wrongly skips one.
+
+#define TT_MAX_PROBES 16
+
+typedef struct {
+  uint64_t key; // 0 means empty.
+  uint32_t value;
+} TTEntry;
+
+typedef struct {
+  TTEntry *entries;
+  uint64_t mask;
+  uint64_t len;
+} TranspositionTable;
+
+static bool tt_init(TranspositionTable *tt, size_t bytes) {
+  SDL_assert(tt != 0);
+
+  uint64_t cap = 1;
+  while (cap * 2 * sizeof(TTEntry) <= bytes)
+    cap *= 2;
+
+  tt->entries = calloc(cap, sizeof(TTEntry));
+  tt->mask = cap - 1;
+  tt->len = 0;
+  return tt->entries != 0;
+}
+
+static void tt_destroy(TranspositionTable *tt) {
+  SDL_assert(tt != 0);
+
+  free(tt->entries);
+  *tt = (TranspositionTable){0};
+}
+
+static void tt_clear(TranspositionTable *tt) {
+  SDL_assert(tt != 0);
+
+  __builtin_memset(tt->entries, 0, (tt->mask + 1) * sizeof(TTEntry));
+  tt->len = 0;
+}
+
+static uint64_t tt_key(uint64_t h) { return h ? h : 1; }
+
+// Returns a pointer to the value stored for `h`, or 0 if absent.
+static uint32_t *tt_find(TranspositionTable *tt, uint64_t h) {
+  SDL_assert(tt != 0);
+
+  const uint64_t key = tt_key(h);
+  uint64_t slot = key & tt->mask;
+  for (uint32_t probe = 0; probe < TT_MAX_PROBES; probe++) {
+    TTEntry *const entry = &tt->entries[slot];
+    if (entry->key == key)
+      return &entry->value;
+    if (entry->key == 0)
+      return 0;
+    slot = (slot + 1) & tt->mask;
+  }
+  return 0;
+}
+
+// Insert `h` unless it is already present. Returns true if it was inserted.
+static bool tt_insert(TranspositionTable *tt, uint64_t h, uint32_t value) {
+  SDL_assert(tt != 0);
+
+  const uint64_t key = tt_key(h);
+  uint64_t slot = key & tt->mask;
+  for (uint32_t probe = 0; probe < TT_MAX_PROBES; probe++) {
+    TTEntry *const entry = &tt->entries[slot];
+    if (entry->key == key)
+      return false;
+    if (entry->key == 0) {
+      *entry = (TTEntry){.key = key, .value = value};
+      tt->len++;
+      return true;
+    }
+    slot = (slot + 1) & tt->mask;
+  }
+
+  // Table is locally full: evict the home slot.
+  tt->entries[key & tt->mask] = (TTEntry){.key = key, .value = value};
+  return true;
+}